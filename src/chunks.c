@@ -0,0 +1,296 @@
+/*
+ * chunks.c: chunk data inflation
+ *
+ * Submitted chunks go into a ring. Workers take them in order, and the
+ * submitting thread writes them out in the same order as they complete. A
+ * full ring makes submitting wait for the oldest chunk, which keeps memory
+ * bounded without ever holding back the workers.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "chunks.h"
+
+enum job_state {
+    JOB_QUEUED,
+    JOB_DONE,
+    JOB_FAILED,
+};
+
+struct chunk_job {
+    enum job_state state;
+    char const* error; /* why it failed */
+    struct chunk_dump_header header;
+
+    mc_byte* compressed;
+    size_t compressed_len;
+    size_t compressed_capacity;
+
+    mc_byte* inflated;
+    size_t inflated_capacity;
+};
+
+struct chunk_pool {
+    FILE* dump;
+
+    struct chunk_job* jobs;
+    size_t slots;
+    uint64_t head; /* oldest job not written */
+    uint64_t next; /* next job for a worker */
+    uint64_t tail; /* next job submitted */
+    bool closing;
+
+    /* the first chunk that failed, written jobs stop there */
+    char const* error;
+    size_t error_offset;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t* workers;
+    unsigned threads;
+};
+
+/*
+ * grows a job buffer, the contents are not kept
+ */
+static mc_byte*
+reserve(mc_byte** buffer, size_t* capacity, size_t const n) {
+    if (n > *capacity) {
+        free(*buffer);
+        *buffer = malloc(n);
+        *capacity = *buffer != NULL ? n : 0;
+    }
+    return *buffer;
+}
+
+/*
+ * inflates as much as the client would take, which is 5 / 2 bytes per block
+ */
+static char const*
+inflate_chunk(z_stream* z, struct chunk_job* job) {
+    struct chunk_dump_header* h = &job->header;
+    size_t const volume = ((size_t) h->size_x + 1) * ((size_t) h->size_y + 1)
+                          * ((size_t) h->size_z + 1);
+    size_t const expected = volume * 5 / 2;
+    if (reserve(&job->inflated, &job->inflated_capacity, expected) == NULL) {
+        return "could not be given memory to inflate into";
+    }
+
+    if (inflateReset(z) != Z_OK) {
+        return "could not be inflated";
+    }
+
+    z->next_in = job->compressed;
+    z->avail_in = (uInt) job->compressed_len;
+    z->next_out = job->inflated;
+    z->avail_out = (uInt) expected;
+
+    /* the client ignores anything past its buffer, short data is kept short */
+    int const rc = inflate(z, Z_FINISH);
+    if (rc != Z_STREAM_END && rc != Z_BUF_ERROR && rc != Z_OK) {
+        return "does not inflate";
+    }
+
+    h->size = (uint32_t) (expected - z->avail_out);
+    return NULL;
+}
+
+static void*
+chunk_worker(void* arg) {
+    struct chunk_pool* pool = arg;
+
+    z_stream z = {0};
+    bool const ready = inflateInit(&z) == Z_OK;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->next == pool->tail && !pool->closing) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+
+        if (pool->next == pool->tail) {
+            break;
+        }
+
+        struct chunk_job* job = &pool->jobs[pool->next++ % pool->slots];
+        pthread_mutex_unlock(&pool->lock);
+
+        char const* error = ready ? inflate_chunk(&z, job) : "could not be inflated";
+
+        pthread_mutex_lock(&pool->lock);
+        job->state = error == NULL ? JOB_DONE : JOB_FAILED;
+        job->error = error;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (ready) {
+        inflateEnd(&z);
+    }
+    return NULL;
+}
+
+struct chunk_pool*
+chunk_pool_start(unsigned const threads, FILE* dump) {
+    assert(threads > 0);
+    assert(dump != NULL);
+
+    struct chunk_pool* pool = calloc(1, sizeof *pool);
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pool->dump = dump;
+    pool->slots = (size_t) threads * CHUNKS_PER_THREAD;
+    pool->jobs = calloc(pool->slots, sizeof *pool->jobs);
+    pool->workers = calloc(threads, sizeof *pool->workers);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    if (pool->jobs == NULL || pool->workers == NULL) {
+        chunk_pool_end(pool);
+        return NULL;
+    }
+
+    for (; pool->threads < threads; pool->threads++) {
+        if (pthread_create(&pool->workers[pool->threads], NULL, chunk_worker, pool) != 0) {
+            chunk_pool_end(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+/*
+ * writes the jobs at the head that are done, in order. called with the
+ * lock held, which is let go while writing.
+ */
+static bool
+write_done(struct chunk_pool* pool) {
+    while (pool->head < pool->tail && pool->error == NULL) {
+        struct chunk_job* job = &pool->jobs[pool->head % pool->slots];
+        if (job->state == JOB_QUEUED) {
+            break;
+        }
+
+        if (job->state == JOB_FAILED) {
+            pool->error = job->error;
+            pool->error_offset = (size_t) job->header.offset;
+            break;
+        }
+
+        /* only the submitting thread moves the head, the job stays put */
+        pthread_mutex_unlock(&pool->lock);
+        fwrite(&job->header, sizeof job->header, 1, pool->dump);
+        fwrite(job->inflated, 1, job->header.size, pool->dump);
+        pthread_mutex_lock(&pool->lock);
+
+        pool->head++;
+    }
+    return pool->error == NULL;
+}
+
+bool
+chunk_pool_submit(struct chunk_pool* pool, size_t const offset,
+                  struct srv_pkt_chunk_data const* pkt) {
+    assert(pool != NULL);
+    assert(pkt != NULL);
+    assert(pkt->compressed_size >= 0);
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        if (!write_done(pool)) {
+            pthread_mutex_unlock(&pool->lock);
+            return false;
+        }
+
+        if (pool->tail - pool->head < pool->slots) {
+            break;
+        }
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    }
+
+    /* the slot is free, no worker looks at it until the tail moves */
+    struct chunk_job* job = &pool->jobs[pool->tail % pool->slots];
+    pthread_mutex_unlock(&pool->lock);
+
+    size_t const len = (size_t) pkt->compressed_size;
+    if (reserve(&job->compressed, &job->compressed_capacity, len) == NULL && len > 0) {
+        fprintf(stderr, "error: could not allocate chunk data\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(job->compressed, pkt->data, len);
+    job->compressed_len = len;
+
+    job->state = JOB_QUEUED;
+    job->header = (struct chunk_dump_header){
+        .offset = offset,
+        .x = pkt->origin.x,
+        .y = pkt->origin.y,
+        .z = pkt->origin.z,
+        .size_x = (uint8_t) pkt->extent.x,
+        .size_y = (uint8_t) pkt->extent.y,
+        .size_z = (uint8_t) pkt->extent.z,
+    };
+
+    pthread_mutex_lock(&pool->lock);
+    pool->tail++;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+bool
+chunk_pool_finish(struct chunk_pool* pool) {
+    assert(pool != NULL);
+
+    pthread_mutex_lock(&pool->lock);
+    while (write_done(pool) && pool->head < pool->tail) {
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    }
+    bool const ok = pool->error == NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    fflush(pool->dump);
+    return ok;
+}
+
+char const*
+chunk_pool_error(struct chunk_pool const* pool, size_t* offset) {
+    assert(pool != NULL);
+    assert(offset != NULL);
+
+    *offset = pool->error_offset;
+    return pool->error;
+}
+
+void
+chunk_pool_end(struct chunk_pool* pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->closing = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned i = 0; i < pool->threads; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    for (size_t i = 0; pool->jobs != NULL && i < pool->slots; i++) {
+        free(pool->jobs[i].compressed);
+        free(pool->jobs[i].inflated);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->cond);
+    free(pool->jobs);
+    free(pool->workers);
+    free(pool);
+}
@@ -0,0 +1,71 @@
+/*
+ * chunks.h: chunk data inflation
+ */
+
+#ifndef OBSIDIAN_CHUNKS_H
+#define OBSIDIAN_CHUNKS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "packet/types.h"
+
+/*
+ * chunks each worker may have in flight before submitting waits
+ */
+#define CHUNKS_PER_THREAD 8
+
+/*
+ * The dump holds every chunk data packet in capture order, in native byte
+ * order. Each is a header followed by the inflated payload as the server
+ * sent it: block types, then the metadata, block light and sky light
+ * nibble arrays.
+ */
+struct chunk_dump_header {
+    uint64_t offset; /* of the packet in the capture */
+    int32_t x;
+    int32_t z;
+    uint32_t size; /* inflated bytes that follow */
+    int16_t y;
+    uint8_t size_x; /* extent, one less than the blocks along each axis */
+    uint8_t size_y;
+    uint8_t size_z;
+    uint8_t reserved[7];
+};
+
+/*
+ * workers inflating chunk data while the caller goes on framing
+ */
+struct chunk_pool;
+
+struct chunk_pool*
+chunk_pool_start(unsigned threads, FILE* dump);
+
+/*
+ * queues a chunk data packet found at the given offset. its payload is
+ * copied, the packet may go away after. returns false when an earlier chunk
+ * failed, see chunk_pool_error.
+ */
+bool
+chunk_pool_submit(struct chunk_pool* pool, size_t offset,
+                  struct srv_pkt_chunk_data const* pkt);
+
+/*
+ * waits for every chunk to be written and stops the workers, returns false
+ * when a chunk failed
+ */
+bool
+chunk_pool_finish(struct chunk_pool* pool);
+
+/*
+ * describes the chunk that failed, and where it was
+ */
+char const*
+chunk_pool_error(struct chunk_pool const* pool, size_t* offset);
+
+void
+chunk_pool_end(struct chunk_pool* pool);
+
+#endif //OBSIDIAN_CHUNKS_H
@@ -3,510 +3,1113 @@
  */
 
 #include <assert.h>
+#include <ctype.h>
+#include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 
-#include "packet/buffer.h"
-
-static char const*
-srv_pkt_name(enum srv_pkt const pkt) {
-    switch (pkt) {
-        case SRV_HEARTBEAT: return "HEARTBEAT";
-        case SRV_AUTH: return "AUTH";
-        case SRV_MESSAGE: return "MESSAGE";
-        case SRV_FULL_POSITION: return "FULL_POS";
-        case SRV_ENT_HOLD_ITEM: return "ENT_HOLD_ITEM";
-        case SRV_RECEIVE_ITEM: return "RECEIVE_ITEM";
-        case SRV_ENT_ANIMATION: return "ENT_ANIMATION";
-        case SRV_SPAWN_PLAYER: return "SPAWN_PLAYER";
-        case SRV_SPAWN_ITEM: return "SPAWN_ITEM";
-        case SRV_ENT_PICKUP: return "ENT_PICKUP";
-        case SRV_ENT_DESTROY: return "ENT_DESTROY";
-        case SRV_ENT_ALIVE: return "ENT_ALIVE";
-        case SRV_ENT_MOVE: return "ENT_MOVE";
-        case SRV_ENT_LOOK: return "ENT_LOOK";
-        case SRV_ENT_MOVE_LOOK: return "ENT_MOVE_LOOK";
-        case SRV_ENT_FULL_POS: return "ENT_FULL_POS";
-        case SRV_CHUNK: return "CHUNK";
-        case SRV_CHUNK_DATA: return "CHUNK_DATA";
-        default: return "UNKNOWN";
-    }
-}
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "chunks.h"
+#include "format.h"
+#include "packet/dispatch.h"
+#include "packet/index.h"
+#include "records.h"
+#include "stats.h"
 
-static size_t
-print_srv_pkt_heartbeat(struct pkt_buffer* r) {
-    size_t const offset = r->in_total - 1;
-    printf("%08zx  %02x:%-15s\n", offset, 0x00, srv_pkt_name(0x00));
-    return 0;
-}
+/*
+ * how a field is printed, after its prefix
+ */
+#define PRINT_NONE(prefix, v) FMT_LITERAL(out, prefix)
+#define PRINT_D(prefix, v) do { FMT_LITERAL(out, prefix); fmt_dec(out, (v)); } while (0)
+#define PRINT_X8(prefix, v) do { FMT_LITERAL(out, prefix); fmt_hex(out, (unsigned) (v), 8); } while (0)
+#define PRINT_X4(prefix, v) do { FMT_LITERAL(out, prefix); fmt_hex(out, (unsigned) (v), 4); } while (0)
+#define PRINT_F2(prefix, v) do { FMT_LITERAL(out, prefix); fmt_f2(out, (double) (v)); } while (0)
+#define PRINT_BOOL(prefix, v) do { FMT_LITERAL(out, prefix); fmt_str(out, (v) ? "true" : "false"); } while (0)
+#define PRINT_ANIM(prefix, v) do { FMT_LITERAL(out, prefix); fmt_str(out, animation_name(v)); } while (0)
+#define PRINT_XZ(prefix, v) do { \
+        FMT_LITERAL(out, prefix "x: "); fmt_dec(out, (v).x); \
+        FMT_LITERAL(out, ", z: "); fmt_dec(out, (v).z); \
+    } while (0)
+#define PRINT_XYZ(prefix, v) do { \
+        FMT_LITERAL(out, prefix); fmt_dec(out, (v).x); \
+        FMT_LITERAL(out, ", "); fmt_dec(out, (v).y); \
+        FMT_LITERAL(out, ", "); fmt_dec(out, (v).z); \
+    } while (0)
 
-static size_t
-print_srv_pkt_auth(struct pkt_buffer* r) {
-    struct srv_pkt_auth pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_auth(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
-    }
+/*
+ * entity positions and rotations need conversion. positions are in 1/32
+ * blocks, and v / 128 * 180 or v / 256 * 360 degrees are both exactly
+ * v * 45 / 32, so all of them print as fixed point.
+ */
+#define PRINT_POS(prefix, v) do { FMT_LITERAL(out, prefix); fmt_q5_1(out, (v)); } while (0)
+#define PRINT_ANG128(prefix, v) do { FMT_LITERAL(out, prefix); fmt_q5_1(out, (int64_t) (v) * 45); } while (0)
+#define PRINT_ANG128_WHOLE(prefix, v) do { FMT_LITERAL(out, prefix); fmt_q5_0(out, (int64_t) (v) * 45); } while (0)
+#define PRINT_ANG256(prefix, v) do { FMT_LITERAL(out, prefix); fmt_q5_1(out, (int64_t) (v) * 45); } while (0)
+
+#define PRINT_V_NONE(prefix, p, len) FMT_LITERAL(out, prefix)
+#define PRINT_V_STR(prefix, p, len) do { \
+        FMT_LITERAL(out, prefix "\""); \
+        fmt_str_n(out, (char const*) (p), (size_t) (len)); \
+        FMT_LITERAL(out, "\""); \
+    } while (0)
+
+#define PRINT_F(type, name, prefix, style) PRINT_##style(prefix, pkt->name);
+#define PRINT_V(name, length, scale, prefix, style) \
+    PRINT_V_##style(prefix, pkt->name, pkt->length * scale);
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x01, srv_pkt_name(0x01));
-    printf("{ unknown0: %" PRIi32 ", unknown1: %" PRIi32 " }\n",
-           pkt.unknown0, pkt.unknown1);
-    return 0;
+/*
+ * the offset, id and name every line starts with
+ */
+static void
+print_header(struct fmt* out, size_t const offset, mc_byte const pkt_id,
+             char const* label) {
+    fmt_hex(out, offset, 8);
+    FMT_LITERAL(out, "  ");
+    fmt_hex(out, pkt_id, 2);
+    FMT_LITERAL(out, ":");
+    fmt_str_left(out, label, 15);
 }
 
-static size_t
-print_srv_pkt_message(struct pkt_buffer* r) {
-    struct srv_pkt_message pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_message(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+/*
+ * printers are the handlers of the dissector, one line per packet to the
+ * output passed as their context
+ */
+#define PRINT_BODY_bare(PFX, pfx, NAME, name, label, suffix) \
+    print_header(out, offset, pkt_id, label); \
+    FMT_LITERAL(out, "\n");
+
+#define PRINT_BODY_fields(PFX, pfx, NAME, name, label, suffix) \
+    struct pfx##_pkt_##name const* pkt = p; \
+    print_header(out, offset, pkt_id, label); \
+    FMT_LITERAL(out, "  "); \
+    PKT_FIELDS(PFX, NAME, PRINT_F, PRINT_V) \
+    FMT_LITERAL(out, suffix "\n");
+
+#define PRINT_BODY_skip(PFX, pfx, NAME, name, label, suffix) \
+    print_header(out, offset, pkt_id, label); \
+    FMT_LITERAL(out, "  skipping "); \
+    fmt_dec(out, (int64_t) length); \
+    FMT_LITERAL(out, " bytes\n");
+
+#define PRINTER(PFX, pfx, NAME, name, id, label, print, suffix) \
+    static void \
+    print_##pfx##_pkt_##name(void* ctx, mc_byte const pkt_id, void const* p, \
+                             size_t const offset, size_t const length) { \
+        struct fmt* out = ctx; \
+        (void) p; \
+        (void) length; \
+        PRINT_BODY_##print(PFX, pfx, NAME, name, label, suffix) \
     }
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x03, srv_pkt_name(0x03));
-    printf("\"%.*s\"\n", pkt.length, (char const*) pkt.bytes);
-    return 0;
+SRV_PACKETS(PRINTER)
+
+#define REGISTER(PFX, pfx, NAME, name, id, label, print, suffix) \
+    pkt_table_register(t, PFX##_##NAME, print_##pfx##_pkt_##name);
+
+static void
+register_printers(struct pkt_table* t) {
+    *t = pkt_srv_table;
+    SRV_PACKETS(REGISTER)
 }
 
-static size_t
-print_srv_pkt_full_position(struct pkt_buffer* r) {
-    struct srv_pkt_full_position pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_full_position(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+enum output_kind {
+    OUTPUT_TEXT,
+    OUTPUT_RECORDS,
+    OUTPUT_STATS,
+};
+
+/*
+ * where packets go, as text or records in the same buffer, or only into
+ * counters
+ */
+struct output {
+    struct fmt fmt;
+    enum output_kind kind;
+    struct records records;
+    struct stats stats;
+
+    /* packets about other entities are skipped without decoding */
+    bool by_entity;
+    entity_id entity;
+
+    /* chunk data is also inflated here when set */
+    struct chunk_pool* chunks;
+};
+
+static void
+output_init(struct output* out, FILE* sink, enum output_kind const kind) {
+    *out = (struct output){.kind = kind};
+    if (fmt_init(&out->fmt, sink) == NULL) {
+        fprintf(stderr, "error: could not allocate output buffer\n");
+        exit(EXIT_FAILURE);
     }
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x0d, srv_pkt_name(0x0d));
-    printf("{ x: %.2f, head_y: %.2f, y: %.2f,  z: %.2f, rotation: %.2f, head_pitch: %.2f, grounded: %s }\n",
-           pkt.x, pkt.head_y, pkt.y, pkt.z, pkt.rotation, pkt.head_pitch, pkt.grounded ? "true" : "false");
-    return 0;
+    if (kind == OUTPUT_RECORDS) {
+        records_init(&out->records, &out->fmt);
+    } else if (kind == OUTPUT_STATS) {
+        stats_init(&out->stats);
+    }
 }
 
-static size_t
-print_srv_pkt_ent_hold_item(struct pkt_buffer* r) {
-    struct srv_pkt_ent_hold_item pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_ent_hold_item(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+/*
+ * the context of the handlers registered for the output
+ */
+static void*
+output_context(struct output* out) {
+    switch (out->kind) {
+        case OUTPUT_RECORDS:
+            return &out->records;
+        case OUTPUT_STATS:
+            return &out->stats;
+        default:
+            return &out->fmt;
     }
-
-    printf("%08zx  %02x:%-15s  ", offset, 0x10, srv_pkt_name(0x10));
-    printf("{ entity: %08x, item: %d }\n", pkt.entity, pkt.item);
-    return 0;
 }
 
-static size_t
-print_srv_pkt_receive_item(struct pkt_buffer* r) {
-    struct srv_pkt_receive_item pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_receive_item(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+/*
+ * writes out everything so far, records included
+ */
+static void
+output_flush(struct output* out) {
+    if (out->kind == OUTPUT_RECORDS) {
+        records_flush(&out->records);
     }
+    fmt_flush(&out->fmt);
+}
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x11, srv_pkt_name(0x11));
-    printf("{ item: %d, count: %d, durability: %d }\n",
-           pkt.item, pkt.count, pkt.durability);
-    return 0;
+static void
+output_end(struct output* out) {
+    if (out->kind == OUTPUT_RECORDS) {
+        records_end(&out->records);
+    } else if (out->kind == OUTPUT_STATS) {
+        stats_end(&out->stats);
+    }
+    fmt_end(&out->fmt);
 }
 
-static size_t
-print_srv_pkt_ent_animation(struct pkt_buffer* r) {
-    struct srv_pkt_ent_animation pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_ent_animation(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+/*
+ * whether a packet whose id was just read is complete and about another
+ * entity, going by its raw bytes. its length is returned for skipping.
+ */
+static bool
+other_entity(struct pkt_table const* t, struct pkt_buffer const* r, mc_byte const id,
+             entity_id const wanted, size_t* len) {
+    size_t const avail = r->cur - r->pos;
+    *len = pkt_length(t, id, &r->data[r->pos], avail);
+    if (*len == PKT_UNKNOWN || *len > avail) {
+        return false;
     }
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x12, srv_pkt_name(0x12));
-    printf("{ entity: %08x, animation: %s }\n",
-           pkt.entity, animation_name(pkt.animation));
-    return 0;
+    entity_id entities[PKT_MAX_ENTITIES];
+    size_t const n = pkt_peek_entities(t, id, &r->data[r->pos], entities);
+    for (size_t i = 0; i < n; i++) {
+        if (entities[i] == wanted) {
+            return false;
+        }
+    }
+    return true;
 }
 
-static size_t
-print_srv_pkt_spawn_player(struct pkt_buffer* r) {
-    struct srv_pkt_spawn_player pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_spawn_player(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
-    }
+/*
+ * reports the chunk that failed to inflate, after the output before it
+ */
+static void
+chunks_failed(struct output* out) {
+    size_t offset;
+    char const* error = chunk_pool_error(out->chunks, &offset);
+    output_flush(out);
+    fprintf(stderr, "error: chunk data at %08zx %s\n", offset, error);
+    exit(EXIT_FAILURE);
+}
 
-    double const x = (double) pkt.x / 32;
-    double const y = (double) pkt.y / 32;
-    double const z = (double) pkt.z / 32;
-    float const yaw = ((float) pkt.yaw / 128.0f) * 180.0f;
-    float const pitch = ((float) pkt.pitch / 128.0f) * 180.0f;
+/*
+ * hands the chunk data packet just dispatched to the inflate workers, its
+ * payload started at the given position
+ */
+static void
+inflate_chunk_data(struct pkt_buffer const* r, size_t const at, size_t const offset,
+                   struct output* out) {
+    struct pkt_buffer copy = *r;
+    copy.pos = at;
+
+    struct srv_pkt_chunk_data pkt;
+    read_srv_pkt_chunk_data(&copy, &pkt);
+    assert(!copy.overflow);
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x14, srv_pkt_name(0x14));
-    printf("{ entity: %08x, name: \"%.*s\", x: %.1f, y: %.1f, z: %.1f, yaw: %.1f, pitch %1.f, item: %d }\n",
-           pkt.entity, pkt.name_length, (char const*) pkt.name,
-           x, y, z, yaw, pitch, pkt.item);
-    return 0;
+    if (!chunk_pool_submit(out->chunks, offset, &pkt)) {
+        chunks_failed(out);
+    }
 }
 
 static size_t
-print_srv_pkt_spawn_item(struct pkt_buffer* r) {
-    struct srv_pkt_spawn_item pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_spawn_item(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+next_packet(struct pkt_table const* t, struct pkt_buffer* r, struct output* out) {
+    size_t const offset = r->in_total;
+    mc_byte pkt_id;
+    read_packet_id(r, &pkt_id);
+    if (r->overflow) {
+        return 1;
+    }
+    size_t const at = r->pos;
+
+    /* incomplete and broken packets go on, dispatching reports them */
+    size_t len;
+    if (out->by_entity && other_entity(t, r, pkt_id, out->entity, &len)) {
+        r->pos += len;
+        r->in_total += len;
+        return 0;
     }
 
-    double const x = (double) pkt.x / 32;
-    double const y = (double) pkt.y / 32;
-    double const z = (double) pkt.z / 32;
-    float const yaw = ((float) pkt.yaw / 128.0f) * 180.0f;
-    float const pitch = ((float) pkt.pitch / 128.0f) * 180.0f;
+    size_t const wanted = pkt_dispatch(t, r, pkt_id, output_context(out));
+    if (wanted == PKT_UNKNOWN) {
+        char const* what = t->entry[pkt_id].measure == NULL ? "unknown" : "malformed";
+        output_flush(out);
+        fprintf(stderr, "error: %s packet 0x%02x at %08zx\n",
+                what, pkt_id, r->in_total - 1);
+        exit(EXIT_FAILURE);
+    }
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x15, srv_pkt_name(0x15));
-    printf("{ entity: %08x, item: %04x, count: %d, x: %.1f, y: %.1f, z: %.1f, yaw: %.1f, pitch: %.1f, unknown: %d }\n",
-           pkt.entity, pkt.item, pkt.count, x, y, z, yaw, pitch, pkt.unknown);
-    return 0;
-}
+    if (r->overflow) {
+        return 1 + wanted;
+    }
 
-static size_t
-print_srv_pkt_ent_pickup(struct pkt_buffer* r) {
-    struct srv_pkt_ent_pickup pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_ent_pickup(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+    /* chunk data filtered out by id is not inflated either */
+    if (out->chunks != NULL && pkt_id == SRV_CHUNK_DATA && t->entry[pkt_id].handle != NULL) {
+        inflate_chunk_data(r, at, offset, out);
     }
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x16, srv_pkt_name(0x16));
-    printf("{ entity: %08x, receiver: %08x }\n", pkt.item, pkt.entity);
-    return 0;
+    return wanted;
 }
 
-static size_t
-print_srv_pkt_ent_destroy(struct pkt_buffer* r) {
-    struct srv_pkt_ent_destroy pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_ent_destroy(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+/*
+ * a ring lets dropping skip the memmove, the heap is a fallback
+ */
+static void
+stream_buffer_init(struct pkt_buffer* r) {
+    if (pkt_buffer_init_mirrored(r, 128) == NULL
+        && pkt_buffer_init(r, 128) == NULL) {
+        fprintf(stderr, "error: could not allocate reader buffer\n");
+        exit(EXIT_FAILURE);
     }
+}
+
+/*
+ * reads every packet in the buffer that is complete. a packet cut off at
+ * the end is rewound, and the buffer made to fit it for the next read.
+ */
+static void
+dissect_buffered(struct pkt_table const* t, struct pkt_buffer* r, struct output* out) {
+    while (r->pos < r->cur) {
+        size_t const start = r->pos;
+        size_t const offset = r->in_total;
+        size_t const needed = next_packet(t, r, out);
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x1d, srv_pkt_name(0x1d));
-    printf("{ entity: %08x }\n", pkt.entity);
-    return 0;
+        /* if we have overflow, then the read failed */
+        if (r->overflow) {
+            /* rewind to the start of the packet */
+            r->pos = start;
+            r->in_total = offset;
+            r->overflow = false;
+
+            /* make sure this packet can fit in our buffer */
+            if (pkt_buffer_reserve(r, needed) == NULL) {
+                output_flush(out);
+                fprintf(stderr, "error: failed to grow buffer to %zu bytes\n",
+                        needed);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        }
+    }
 }
 
-static size_t
-print_srv_pkt_ent_alive(struct pkt_buffer* r) {
-    struct srv_pkt_ent_alive pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_ent_alive(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+/*
+ * the stream ended, which it may not do in the middle of a packet
+ */
+static void
+stream_end(struct pkt_buffer* r, struct output* out) {
+    if (r->pos < r->cur) {
+        output_flush(out);
+        fprintf(stderr, "error: unexpected EOF\n");
+        exit(EXIT_FAILURE);
     }
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x1e, srv_pkt_name(0x1e));
-    printf("{ entity: %08x }\n", pkt.entity);
-    return 0;
+    pkt_buffer_end(r);
 }
 
-static size_t
-print_srv_pkt_ent_move(struct pkt_buffer* r) {
-    struct srv_pkt_ent_move pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_ent_move(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
-    }
+static void
+dissect_stream(struct pkt_table const* t, FILE* stream, struct output* out) {
+    assert(t != NULL);
+    assert(stream != NULL);
+    assert(out != NULL);
 
-    double const x = (double) pkt.x / 32.0;
-    double const y = (double) pkt.y / 32.0;
-    double const z = (double) pkt.z / 32.0;
+    struct pkt_buffer r;
+    stream_buffer_init(&r);
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x1f, srv_pkt_name(0x1f));
-    printf("{ entity: %08x, x: %.1f, y: %.1f, z: %.1f }\n",
-           pkt.id, x, y, z);
-    return 0;
-}
+    bool eof = false;
+    while (!eof) {
+        /* drop unneeded bytes first */
+        pkt_buffer_drop(&r);
 
-static size_t
-print_srv_pkt_ent_look(struct pkt_buffer* r) {
-    struct srv_pkt_ent_look pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_ent_look(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+        /* read as many bytes as we can */
+        size_t const got = pkt_buffer_fread(&r, stream);
+        eof = got == 0 && (feof(stream) || ferror(stream));
+
+        /* then read every packet that is complete */
+        dissect_buffered(t, &r, out);
     }
 
-    float const yaw = ((float) pkt.yaw / 256.0f) * 360.0f;
-    float const pitch = ((float) pkt.pitch / 256.0f) * 360.0f;
+    stream_end(&r, out);
+}
+
+/*
+ * how long to sleep between looks at a growing file that cannot be watched
+ */
+#define FOLLOW_INTERVAL_MS 5
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x20, srv_pkt_name(0x20));
-    printf("{ entity: %08x, yaw: %.1f, pitch: %.1f }\n", pkt.id, yaw, pitch);
-    return 0;
+/*
+ * puts what was dissected so far in front of the reader, before waiting
+ */
+static void
+follow_flush(struct output* out) {
+    output_flush(out);
+    fflush(out->fmt.sink);
 }
 
-static size_t
-print_srv_pkt_ent_move_look(struct pkt_buffer* r) {
-    struct srv_pkt_ent_move_look pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_ent_move_look(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+/*
+ * waits until a followed file may have grown, returns false once it was
+ * deleted. the open descriptor keeps a deleted file around, so that shows
+ * up as its last link going rather than as IN_DELETE_SELF.
+ */
+static bool
+wait_for_growth(int const fd, int const notify) {
+    if (notify < 0) {
+        poll(NULL, 0, FOLLOW_INTERVAL_MS);
+        return true;
     }
 
-    double const x = (double) pkt.x / 32.0;
-    double const y = (double) pkt.y / 32.0;
-    double const z = (double) pkt.z / 32.0;
-    float const yaw = ((float) pkt.yaw / 256.0f) * 360.0f;
-    float const pitch = ((float) pkt.pitch / 256.0f) * 360.0f;
+    struct pollfd p = {.fd = notify, .events = POLLIN};
+    if (poll(&p, 1, -1) < 0) {
+        return errno == EINTR;
+    }
+
+    /* the events themselves do not matter, only that there were some */
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    if (read(notify, events, sizeof events) < 0 && errno != EINTR) {
+        return false;
+    }
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x21, srv_pkt_name(0x21));
-    printf("{ entity: %08x, x: %.1f, y: %.1f, z: %.1f, yaw: %.1f, pitch: %.1f }\n",
-           pkt.id, x, y, z, yaw, pitch);
-    return 0;
+    struct stat st;
+    return fstat(fd, &st) == 0 && st.st_nlink > 0;
 }
 
-static size_t
-print_srv_pkt_ent_full_pos(struct pkt_buffer* r) {
-    struct srv_pkt_ent_full_pos pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_ent_full_pos(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+/*
+ * dissects a capture that is still being written, or a live pipe. the end
+ * of a file is waited out with inotify, a pipe is polled, and the framing
+ * state is kept across the waits. a file is followed until it is deleted,
+ * a pipe until its writer closes it.
+ */
+static void
+dissect_follow(struct pkt_table const* t, char const* filename, int const fd,
+               struct output* out) {
+    assert(t != NULL);
+    assert(filename != NULL);
+    assert(out != NULL);
+
+    struct stat st;
+    bool const regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+
+    /* watch before reading, so no append can slip in between */
+    int notify = -1;
+    if (regular) {
+        notify = inotify_init1(IN_CLOEXEC);
+        uint32_t const mask = IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF;
+        if (notify >= 0 && inotify_add_watch(notify, filename, mask) < 0) {
+            close(notify);
+            notify = -1;
+        }
     }
 
-    /* entity positions and rotations need conversion */
-    double const x = (double) pkt.x / 32;
-    double const y = (double) pkt.y / 32;
-    double const z = (double) pkt.z / 32;
-    float const yaw = ((float) pkt.yaw / 256.0f) * 360.0f;
-    float const pitch = ((float) pkt.pitch / 256.0f) * 360.0f;
+    struct pkt_buffer r;
+    stream_buffer_init(&r);
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x22, srv_pkt_name(0x22));
-    printf("{ entity: %08x, x: %.1f, y: %.1f, z: %.1f, yaw: %.1f, pitch: %.1f }\n",
-           pkt.id, x, y, z, yaw, pitch);
-    return 0;
-}
+    for (;;) {
+        pkt_buffer_drop(&r);
 
-static size_t
-print_srv_pkt_chunk(struct pkt_buffer* r) {
-    struct srv_pkt_chunk pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_chunk(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+        /* a pipe with nothing ready would block the read */
+        if (!regular) {
+            struct pollfd p = {.fd = fd, .events = POLLIN};
+            if (poll(&p, 1, 0) == 0) {
+                follow_flush(out);
+                poll(&p, 1, -1);
+            }
+        }
+
+        ssize_t const got = pkt_buffer_read(&r, fd);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (got < 0) {
+            output_flush(out);
+            fprintf(stderr, "error: could not read %s\n", filename);
+            exit(EXIT_FAILURE);
+        }
+
+        if (got > 0) {
+            dissect_buffered(t, &r, out);
+            continue;
+        }
+
+        /* the end of a pipe is final, a file may still grow */
+        follow_flush(out);
+        if (!regular || !wait_for_growth(fd, notify)) {
+            break;
+        }
     }
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x32, srv_pkt_name(0x32));
-    printf("{ x: %d, z: %d, load: %s }\n",
-           pkt.chunk.x, pkt.chunk.z, pkt.load ? "true" : "false");
-    return 0;
+    if (notify >= 0) {
+        close(notify);
+    }
+    stream_end(&r, out);
 }
 
-static size_t
-print_srv_pkt_chunk_data(struct pkt_buffer* r) {
-    struct srv_pkt_chunk_data pkt;
-    size_t const offset = r->in_total - 1;
-    size_t const wanted = read_srv_pkt_chunk_data(r, &pkt);
-    if (wanted != 0) {
-        return wanted;
+/*
+ * dissects the part of a capture in memory from the given offset on
+ */
+static void
+dissect_mapped(struct pkt_table const* t, uint8_t const* data,
+               size_t const start, size_t const size, struct output* out) {
+    assert(t != NULL);
+    assert(data != NULL);
+    assert(start <= size);
+    assert(out != NULL);
+
+    /* the reader never writes, it only needs the whole capture in view */
+    struct pkt_buffer r = {
+        .data = (uint8_t*) data,
+        .pos = start,
+        .cur = size,
+        .capacity = size,
+        .in_total = start,
+    };
+
+    while (r.pos < r.cur) {
+        next_packet(t, &r, out);
+        if (r.overflow) {
+            output_flush(out);
+            fprintf(stderr, "error: unexpected EOF\n");
+            exit(EXIT_FAILURE);
+        }
     }
+}
 
-    printf("%08zx  %02x:%-15s  ", offset, 0x33, srv_pkt_name(0x33));
-    printf("{ origin( %d, %d, %d ), extent( %d, %d, %d ) "
-           "size %" PRIi32", data: ... }\n",
-           pkt.origin.x, pkt.origin.y, pkt.origin.z,
-           pkt.extent.x, pkt.extent.y, pkt.extent.z,
-           pkt.compressed_size);
+/*
+ * bytes a worker dissects at a time, and how many chunks may be in flight
+ * per worker before the output catches up
+ */
+#define CHUNK_SIZE (1024u * 1024)
+#define CHUNKS_PER_WORKER 4
 
-    return 0;
-}
+struct chunk {
+    size_t start;
+    size_t end;
+    char* out;
+    size_t len;
+    bool done;
+};
 
-static size_t
-print_srv_pkt_0x34(struct pkt_buffer* r) {
-    size_t const offset = r->in_total - 1;
-    size_t const start = r->in_total;
-    size_t const wanted = read_srv_pkt_0x34(r);
-    if (wanted != 0) {
-        return wanted;
+/*
+ * a capture split at packet boundaries, shared by the workers
+ */
+struct job {
+    struct pkt_table const* table;
+    enum output_kind kind;
+    bool by_entity;
+    entity_id entity;
+    uint8_t const* data;
+    struct chunk* chunks;
+    size_t count;
+    size_t window; /* chunks that may be ahead of the output */
+    size_t next; /* next chunk to dissect */
+    size_t written; /* chunks written to the output */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+/*
+ * adds a chunk to the job
+ */
+static void
+push_chunk(struct job* job, size_t* capacity, size_t const start, size_t const end) {
+    if (job->count == *capacity) {
+        *capacity = *capacity == 0 ? 64 : *capacity * 2;
+        job->chunks = realloc(job->chunks, *capacity * sizeof *job->chunks);
+        if (job->chunks == NULL) {
+            fprintf(stderr, "error: could not allocate chunks\n");
+            exit(EXIT_FAILURE);
+        }
     }
 
-    size_t const end = r->in_total;
-    printf("%08zx  %02x:%-15s  ", offset, 0x34, srv_pkt_name(0x34));
-    printf("skipping %zu bytes\n", end - start);
-    return 0;
+    job->chunks[job->count++] = (struct chunk){.start = start, .end = end};
 }
 
+/*
+ * finds chunk boundaries with the length oracle alone, and returns where
+ * the capture stops being dissectable
+ */
 static size_t
-print_srv_pkt_0x35(struct pkt_buffer* r) {
-    size_t const offset = r->in_total - 1;
-    size_t const start = r->in_total;
-    size_t const wanted = read_srv_pkt_0x35(r);
-    if (wanted != 0) {
-        return wanted;
+scan_chunks(struct job* job, size_t const size) {
+    size_t capacity = 0;
+    size_t start = 0;
+    size_t off = 0;
+    while (off < size) {
+        mc_byte const id = job->data[off];
+        size_t const avail = size - off - sizeof id;
+        size_t const len = pkt_length(job->table, id, &job->data[off + sizeof id], avail);
+        if (len == PKT_UNKNOWN || len > avail) {
+            break;
+        }
+
+        off += sizeof id + len;
+        if (off - start >= CHUNK_SIZE) {
+            push_chunk(job, &capacity, start, off);
+            start = off;
+        }
     }
 
-    size_t const end = r->in_total;
-    printf("%08zx  %02x:%-15s  ", offset, 0x35, srv_pkt_name(0x35));
-    printf("skipping %zu bytes\n", end - start);
-    return 0;
+    if (off > start) {
+        push_chunk(job, &capacity, start, off);
+    }
+    return off;
 }
 
-static size_t
-read_packet(struct pkt_buffer* r, mc_byte const pkt_id) {
-    switch (pkt_id) {
-        case SRV_HEARTBEAT:
-            return print_srv_pkt_heartbeat(r);
-
-        case SRV_AUTH:
-            return print_srv_pkt_auth(r);
+static void*
+dissect_worker(void* arg) {
+    struct job* job = arg;
 
-        case SRV_MESSAGE:
-            return print_srv_pkt_message(r);
+    pthread_mutex_lock(&job->lock);
+    for (;;) {
+        /* stay within the window, so output memory stays bounded */
+        while (job->next < job->count && job->next >= job->written + job->window) {
+            pthread_cond_wait(&job->cond, &job->lock);
+        }
 
-        case SRV_FULL_POSITION:
-            return print_srv_pkt_full_position(r);
+        if (job->next == job->count) {
+            break;
+        }
 
-        case SRV_ENT_HOLD_ITEM:
-            return print_srv_pkt_ent_hold_item(r);
+        struct chunk* c = &job->chunks[job->next++];
+        pthread_mutex_unlock(&job->lock);
+
+        /* without a sink the output stays in memory until its turn */
+        struct output out;
+        output_init(&out, NULL, job->kind);
+        out.by_entity = job->by_entity;
+        out.entity = job->entity;
+        /* the main thread blocks the records, in capture order */
+        out.records.rows = job->kind == OUTPUT_RECORDS;
+
+        /* offsets are printed relative to the whole capture */
+        struct pkt_buffer r = {
+            .data = (uint8_t*) job->data,
+            .pos = c->start,
+            .cur = c->end,
+            .capacity = c->end,
+            .in_total = c->start,
+        };
+
+        /* the scan made sure every packet is complete */
+        while (r.pos < r.cur) {
+            next_packet(job->table, &r, &out);
+            assert(!r.overflow);
+        }
+        if (out.kind == OUTPUT_RECORDS) {
+            records_end(&out.records);
+        }
+        c->out = out.fmt.data;
+        c->len = out.fmt.len;
 
-        case SRV_RECEIVE_ITEM:
-            return print_srv_pkt_receive_item(r);
+        pthread_mutex_lock(&job->lock);
+        c->done = true;
+        pthread_cond_broadcast(&job->cond);
+    }
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
 
-        case SRV_ENT_ANIMATION:
-            return print_srv_pkt_ent_animation(r);
+/*
+ * dissects a mapped capture with several workers, the output is the same as
+ * that of a single one. records come back from the workers as rows, so they
+ * are blocked here as a single worker would have.
+ */
+static void
+dissect_parallel(struct pkt_table const* t, uint8_t const* data,
+                 size_t const size, unsigned const threads, struct output* out) {
+    assert(t != NULL);
+    assert(data != NULL);
+    assert(threads > 1);
+    assert(out != NULL);
+
+    struct job job = {
+        .table = t,
+        .kind = out->kind,
+        .by_entity = out->by_entity,
+        .entity = out->entity,
+        .data = data,
+        .window = (size_t) threads * CHUNKS_PER_WORKER,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+    };
+
+    size_t const end = scan_chunks(&job, size);
+
+    /* text goes straight to the sink, so nothing may be left buffered */
+    fmt_flush(&out->fmt);
+
+    pthread_t workers[threads];
+    for (unsigned i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, dissect_worker, &job) != 0) {
+            fprintf(stderr, "error: could not start worker\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 
-        case SRV_SPAWN_PLAYER:
-            return print_srv_pkt_spawn_player(r);
+    /* write every chunk in order as soon as it is done */
+    for (size_t i = 0; i < job.count; i++) {
+        struct chunk* c = &job.chunks[i];
 
-        case SRV_SPAWN_ITEM:
-            return print_srv_pkt_spawn_item(r);
+        pthread_mutex_lock(&job.lock);
+        while (!c->done) {
+            pthread_cond_wait(&job.cond, &job.lock);
+        }
+        pthread_mutex_unlock(&job.lock);
 
-        case SRV_ENT_PICKUP:
-            return print_srv_pkt_ent_pickup(r);
+        if (out->kind == OUTPUT_RECORDS) {
+            records_add_rows(&out->records, (uint8_t const*) c->out, c->len);
+        } else {
+            fwrite(c->out, 1, c->len, out->fmt.sink);
+        }
+        free(c->out);
 
-        case SRV_ENT_DESTROY:
-            return print_srv_pkt_ent_destroy(r);
+        pthread_mutex_lock(&job.lock);
+        job.written++;
+        pthread_cond_broadcast(&job.cond);
+        pthread_mutex_unlock(&job.lock);
+    }
 
-        case SRV_ENT_ALIVE:
-            return print_srv_pkt_ent_alive(r);
+    for (unsigned i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(job.chunks);
 
-        case SRV_ENT_MOVE:
-            return print_srv_pkt_ent_move(r);
+    /* whatever stopped the scan is reported as the serial path would */
+    dissect_mapped(t, data, end, size, out);
+}
 
-        case SRV_ENT_LOOK:
-            return print_srv_pkt_ent_look(r);
+/*
+ * maps a regular file for reading front to back, or returns NULL
+ */
+static uint8_t const*
+map_capture(int const fd, size_t* size) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        return NULL;
+    }
 
-        case SRV_ENT_MOVE_LOOK:
-            return print_srv_pkt_ent_move_look(r);
+    void* data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
 
-        case SRV_ENT_FULL_POS:
-            return print_srv_pkt_ent_full_pos(r);
+    madvise(data, (size_t) st.st_size, MADV_SEQUENTIAL);
+    *size = (size_t) st.st_size;
+    return data;
+}
 
-        case SRV_CHUNK:
-            return print_srv_pkt_chunk(r);
+struct options {
+    unsigned threads;
+    enum output_kind output;
+    bool ranged; /* from or to was given */
+    uint64_t from;
+    uint64_t to;
+    bool by_entity;
+    entity_id entity;
+    bool only; /* only the ids below get handlers */
+    bool ids[256];
+    char const* chunks; /* dump of inflated chunk data */
+    bool follow; /* wait for more at the end */
+};
 
-        case SRV_CHUNK_DATA:
-            return print_srv_pkt_chunk_data(r);
+/*
+ * maps the index of a capture, building it first when it is missing or
+ * stale. an index that cannot be written is used from memory.
+ */
+static void
+open_index(struct pkt_index* idx, struct pkt_table const* t, char const* filename,
+           int const fd, uint8_t const* data, size_t const size) {
+    char path[4096];
+    if ((size_t) snprintf(path, sizeof path, "%s.idx", filename) >= sizeof path) {
+        fprintf(stderr, "error: capture path too long\n");
+        exit(EXIT_FAILURE);
+    }
 
-        case SRV_0x34:
-            return print_srv_pkt_0x34(r);
+    struct stat capture;
+    if (fstat(fd, &capture) != 0) {
+        fprintf(stderr, "error: could not stat %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
 
-        case SRV_0x35:
-            return print_srv_pkt_0x35(r);
+    if (pkt_index_open(idx, path, &capture)) {
+        return;
+    }
 
-        default:
-            fprintf(stderr, "unknown packet 0x%02x\n", pkt_id);
-            exit(EXIT_FAILURE);
+    if (!pkt_index_build(idx, t, data, size, &capture)) {
+        fprintf(stderr, "error: could not index %s\n", filename);
+        exit(EXIT_FAILURE);
     }
+
+    /* a read-only directory only costs the next run a rebuild */
+    pkt_index_write(idx, path);
 }
 
-static size_t
-next_packet(struct pkt_buffer* r) {
-    mc_byte pkt_id;
-    read_packet_id(r, &pkt_id);
-    if (r->overflow) {
-        return 1;
-    }
+/*
+ * dissects the packets selected by offset range and entity, seeking with the
+ * index instead of replaying the capture
+ */
+static void
+dissect_indexed(struct pkt_table const* t, char const* filename, int const fd,
+                uint8_t const* data, size_t const size, struct options const* opts,
+                struct output* out) {
+    struct pkt_index idx;
+    open_index(&idx, t, filename, fd, data, size);
+
+    size_t const count = (size_t) idx.header->count;
+    size_t const first = pkt_index_seek(&idx, opts->from);
+    size_t const last = pkt_index_seek(&idx, opts->to);
+    size_t const end = last < count ? (size_t) idx.records[last].offset : size;
+
+    if (opts->by_entity) {
+        size_t at;
+        size_t const n = pkt_index_entity(&idx, opts->entity, &at);
+        for (size_t i = at; i < at + n; i++) {
+            uint64_t const record = idx.by_entity[i].record;
+            if (record < first || record >= last) {
+                continue;
+            }
 
-    size_t const wanted = read_packet(r, pkt_id);
-    if (r->overflow) {
-        return 1 + wanted;
+            struct pkt_buffer r = {
+                .data = (uint8_t*) data,
+                .pos = (size_t) idx.records[record].offset,
+                .cur = size,
+                .capacity = size,
+                .in_total = (size_t) idx.records[record].offset,
+            };
+            next_packet(t, &r, out);
+        }
+
+        /* the packets past the index are filtered as they are replayed, so
+         * whatever stopped the index is reported as a full run would */
+        size_t const tail = (size_t) idx.header->end;
+        if (tail < end) {
+            dissect_mapped(t, data, tail, end, out);
+        }
+    } else {
+        size_t const start = first < count ? (size_t) idx.records[first].offset
+                                           : (size_t) idx.header->end;
+
+        /* past the indexed packets, whatever stopped the index is reported */
+        if (start < end) {
+            dissect_mapped(t, data, start, end, out);
+        }
     }
 
-    return wanted;
+    pkt_index_close(&idx);
+}
+
+/*
+ * stats are not merged across workers, and with --chunks the threads
+ * inflate while a single one frames
+ */
+static bool
+dissects_parallel(struct options const* opts) {
+    return opts->threads > 1 && opts->output != OUTPUT_STATS && opts->chunks == NULL;
 }
 
 static void
-dissect_stream(FILE* stream) {
-    assert(stream != NULL);
+dissect(char const* filename, struct options const* opts) {
+    assert(filename != NULL);
+    assert(opts != NULL);
 
-    struct pkt_buffer r = {0};
-    if (pkt_buffer_init(&r, 128) == NULL) {
-        fprintf(stderr, "error: could not allocate reader buffer\n");
-        exit(EXIT_FAILURE);
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return;
     }
 
-    while (!feof(stream)) {
-        /* drop unneeded bytes first */
-        pkt_buffer_drop(&r);
+    struct pkt_table printers;
+    if (opts->output == OUTPUT_RECORDS) {
+        records_register(&printers);
+    } else if (opts->output == OUTPUT_STATS) {
+        stats_register(&printers);
+    } else {
+        register_printers(&printers);
+    }
 
-        /* read as many bytes as we can */
-        if (pkt_buffer_fread(&r, stream) == 0 && feof(stream)) {
-            fprintf(stderr, "error: unexpected EOF\n");
+    /* packets without a handler are skipped by their length */
+    if (opts->only) {
+        for (size_t id = 0; id < 256; id++) {
+            if (!opts->ids[id] && printers.entry[id].decode != NULL) {
+                pkt_table_register(&printers, (mc_byte) id, NULL);
+            }
+        }
+    }
+
+    struct output out;
+    output_init(&out, stdout, opts->output);
+    out.by_entity = opts->by_entity;
+    out.entity = opts->entity;
+    if (opts->output == OUTPUT_RECORDS) {
+        records_write_header(&out.fmt);
+    }
+
+    FILE* dump = NULL;
+    if (opts->chunks != NULL) {
+        dump = fopen(opts->chunks, "wb");
+        if (dump == NULL) {
+            fprintf(stderr, "error: could not open chunk dump %s\n", opts->chunks);
             exit(EXIT_FAILURE);
         }
 
-        /* attempt to read the next packet */
-        size_t const start = r.pos;
-        size_t const offset = r.in_total;
-        size_t const needed = next_packet(&r);
+        out.chunks = chunk_pool_start(opts->threads, dump);
+        if (out.chunks == NULL) {
+            fprintf(stderr, "error: could not start chunk workers\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 
-        /* if we have overflow, then the read failed */
-        if (r.overflow) {
-            /* rewind to the start of the packet */
-            r.pos = start;
-            r.in_total = offset;
-            r.overflow = false;
-
-            /* can this packet fit in our buffer? */
-            if (needed > r.capacity) {
-                if (pkt_buffer_resize(&r, needed) == NULL) {
-                    fprintf(stderr, "error: failed to grow buffer\n");
-                    exit(EXIT_FAILURE);
-                }
-            }
+    /* map the capture when we can, anything else is read as a stream */
+    size_t size = 0;
+    uint8_t const* data = NULL;
+    if (!opts->follow) {
+        data = map_capture(fileno(file), &size);
+    }
+
+    if (opts->ranged && opts->follow) {
+        fprintf(stderr, "error: --from and --to cannot be followed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (opts->ranged && data == NULL) {
+        fprintf(stderr, "error: --from and --to need a capture file\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* a capture file is searched with its index, a stream filtered as it goes */
+    if (data != NULL && (opts->ranged || opts->by_entity)) {
+        dissect_indexed(&printers, filename, fileno(file), data, size, opts, &out);
+        munmap((void*) data, size);
+    } else if (data != NULL && dissects_parallel(opts)) {
+        dissect_parallel(&printers, data, size, opts->threads, &out);
+        munmap((void*) data, size);
+    } else if (data != NULL) {
+        dissect_mapped(&printers, data, 0, size, &out);
+        munmap((void*) data, size);
+    } else if (opts->follow) {
+        dissect_follow(&printers, filename, fileno(file), &out);
+    } else {
+        dissect_stream(&printers, file, &out);
+    }
+
+    if (out.chunks != NULL) {
+        if (!chunk_pool_finish(out.chunks)) {
+            chunks_failed(&out);
         }
+        chunk_pool_end(out.chunks);
+        fclose(dump);
+    }
+
+    if (opts->output == OUTPUT_STATS) {
+        fmt_flush(&out.fmt);
+        stats_print(&out.stats, stdout);
     }
+    output_end(&out);
+    fclose(file);
 }
 
 static void
-dissect(char const* filename) {
-    assert(filename != NULL);
+usage(void) {
+    fprintf(stderr, "Usage: dissect [-j THREADS] [--binary | --stats] [--only IDS] [--chunks DUMP] [--follow] [--from OFFSET] [--to OFFSET] [--entity ID] FILE\n");
+    fprintf(stderr, "  -j THREADS     dissect a capture file with this many workers (default 1, at most 4 per cpu)\n");
+    fprintf(stderr, "  --binary       write packets as binary records, see records.h\n");
+    fprintf(stderr, "  --stats        only count packets, then print a summary (one thread)\n");
+    fprintf(stderr, "  --only IDS     only packets with these ids, like 0x21,0x22\n");
+    fprintf(stderr, "  --chunks DUMP  inflate chunk data on the -j threads into DUMP, see chunks.h\n");
+    fprintf(stderr, "  --follow       keep reading a capture that is still being written\n");
+    fprintf(stderr, "  --from OFFSET  start at the first packet at or after this offset\n");
+    fprintf(stderr, "  --to OFFSET    stop before the first packet at or after this offset\n");
+    fprintf(stderr, "  --entity ID    only packets naming this entity, in any entity field\n");
+    fprintf(stderr, "On a capture file the last three use an index kept in FILE.idx, built\n");
+    fprintf(stderr, "when missing, or only in memory when FILE.idx cannot be written. A\n");
+    fprintf(stderr, "stream is filtered by entity as it is read.\n");
+}
 
-    FILE* file = fopen(filename, "rb");
-    if (file == NULL) {
-        return;
+/*
+ * parses a comma separated list of packet ids
+ */
+static void
+parse_ids(char const* arg, bool* ids) {
+    char* end;
+    do {
+        unsigned long const id = strtoul(arg, &end, 0);
+        if (end == arg || id > 0xff || pkt_srv_table.entry[id].decode == NULL) {
+            fprintf(stderr, "error: --only takes known packet ids, like 0x21,0x22\n");
+            exit(EXIT_FAILURE);
+        }
+
+        ids[id] = true;
+        arg = end + 1;
+    } while (*end == ',');
+
+    if (*end != '\0') {
+        fprintf(stderr, "error: --only takes known packet ids, like 0x21,0x22\n");
+        exit(EXIT_FAILURE);
     }
+}
 
-    dissect_stream(file);
-    fclose(file);
+/*
+ * most threads -j takes for every online cpu
+ */
+#define THREADS_PER_CPU 4
+
+static uint64_t
+max_threads(void) {
+    long const cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return THREADS_PER_CPU * (uint64_t) (cpus > 0 ? cpus : 1);
+}
+
+/*
+ * parses a whole argument as a number no larger than max. a sign, leading
+ * space, trailing characters or an empty argument make it fail.
+ */
+static bool
+parse_number(char const* arg, int const base, uint64_t const max, uint64_t* value) {
+    if (!isdigit((unsigned char) arg[0])) {
+        return false;
+    }
+
+    char* end;
+    errno = 0;
+    unsigned long long const n = strtoull(arg, &end, base);
+    if (errno != 0 || *end != '\0' || n > max) {
+        return false;
+    }
+
+    *value = n;
+    return true;
 }
 
 int
 main(int argc, char** argv) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: dissect FILE\n");
+    struct options opts = {
+        .threads = 1,
+        .to = UINT64_MAX,
+    };
+
+    static struct option const long_opts[] = {
+        {"binary", no_argument, NULL, 'b'},
+        {"stats", no_argument, NULL, 's'},
+        {"only", required_argument, NULL, 'o'},
+        {"chunks", required_argument, NULL, 'c'},
+        {"follow", no_argument, NULL, 'F'},
+        {"from", required_argument, NULL, 'f'},
+        {"to", required_argument, NULL, 't'},
+        {"entity", required_argument, NULL, 'e'},
+        {0},
+    };
+
+    uint64_t n;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'j':
+                if (!parse_number(optarg, 10, max_threads(), &n)) {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                opts.threads = (unsigned) n;
+                break;
+
+            case 'b':
+                opts.output = OUTPUT_RECORDS;
+                break;
+
+            case 's':
+                opts.output = OUTPUT_STATS;
+                break;
+
+            case 'o':
+                parse_ids(optarg, opts.ids);
+                opts.only = true;
+                break;
+
+            case 'c':
+                opts.chunks = optarg;
+                break;
+
+            case 'F':
+                opts.follow = true;
+                break;
+
+            case 'f':
+                if (!parse_number(optarg, 0, UINT64_MAX, &opts.from)) {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                opts.ranged = true;
+                break;
+
+            case 't':
+                if (!parse_number(optarg, 0, UINT64_MAX, &opts.to)) {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                opts.ranged = true;
+                break;
+
+            case 'e':
+                /* entity ids are never negative */
+                if (!parse_number(optarg, 0, INT32_MAX, &n)) {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                opts.entity = (entity_id) n;
+                opts.by_entity = true;
+                break;
+
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (opts.threads == 0 || optind + 1 != argc) {
+        usage();
         return EXIT_FAILURE;
     }
 
-    char const* filename = argv[1];
-    dissect(filename);
+    char const* filename = argv[optind];
+    dissect(filename, &opts);
 
-    printf("Reached end of stream, goodbye!! :-)\n");
+    /* records are read by programs, which would not expect a greeting */
+    if (opts.output != OUTPUT_RECORDS) {
+        printf("Reached end of stream, goodbye!! :-)\n");
+    }
     return EXIT_SUCCESS;
 }
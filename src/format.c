@@ -0,0 +1,251 @@
+/*
+ * format.c: buffered text output
+ *
+ * printf rounds the exact binary value of a number to the nearest decimal,
+ * ties going to the even digit. The fixed point formatters do the same with
+ * integers. For doubles, the fraction times 100 is exact in a long double
+ * with a 64 bit mantissa, so it can be rounded exactly too. Anything else
+ * goes to snprintf.
+ */
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "format.h"
+
+/* longest number any formatter writes itself */
+#define NUMBER_MAX 32u
+
+struct fmt*
+fmt_init(struct fmt* f, FILE* sink) {
+    assert(f != NULL);
+
+    char* data = malloc(FMT_BUFFER_SIZE);
+    if (data == NULL) {
+        return NULL;
+    }
+
+    *f = (struct fmt){
+        .data = data,
+        .capacity = FMT_BUFFER_SIZE,
+        .sink = sink,
+    };
+    return f;
+}
+
+void
+fmt_flush(struct fmt* f) {
+    assert(f != NULL);
+
+    if (f->sink != NULL && f->len > 0) {
+        fwrite(f->data, 1, f->len, f->sink);
+        f->len = 0;
+    }
+}
+
+void
+fmt_end(struct fmt* f) {
+    assert(f != NULL);
+
+    fmt_flush(f);
+    free(f->data);
+    *f = (struct fmt){0};
+}
+
+char*
+fmt_room(struct fmt* f, size_t const n) {
+    assert(f != NULL);
+
+    if (f->capacity - f->len >= n) {
+        return &f->data[f->len];
+    }
+
+    fmt_flush(f);
+    if (f->capacity - f->len < n) {
+        size_t capacity = f->capacity * 2;
+        while (capacity - f->len < n) {
+            capacity *= 2;
+        }
+
+        char* data = realloc(f->data, capacity);
+        if (data == NULL) {
+            fprintf(stderr, "error: could not grow output buffer to %zu bytes\n",
+                    capacity);
+            exit(EXIT_FAILURE);
+        }
+        f->data = data;
+        f->capacity = capacity;
+    }
+    return &f->data[f->len];
+}
+
+void
+fmt_bytes(struct fmt* f, void const* b, size_t const len) {
+    memcpy(fmt_room(f, len), b, len);
+    f->len += len;
+}
+
+void
+fmt_str(struct fmt* f, char const* s) {
+    fmt_bytes(f, s, strlen(s));
+}
+
+void
+fmt_str_left(struct fmt* f, char const* s, unsigned const width) {
+    size_t const len = strlen(s);
+    size_t const pad = len < width ? width - len : 0;
+
+    char* p = fmt_room(f, len + pad);
+    memcpy(p, s, len);
+    memset(&p[len], ' ', pad);
+    f->len += len + pad;
+}
+
+void
+fmt_str_n(struct fmt* f, char const* s, size_t const len) {
+    char const* nul = memchr(s, '\0', len);
+    fmt_bytes(f, s, nul != NULL ? (size_t) (nul - s) : len);
+}
+
+/*
+ * writes the digits of x backwards from the end of a scratch buffer
+ */
+static char*
+digits(char* end, uint64_t x) {
+    do {
+        *--end = (char) ('0' + x % 10);
+        x /= 10;
+    } while (x != 0);
+    return end;
+}
+
+static void
+fmt_unsigned(struct fmt* f, bool const negative, uint64_t const x) {
+    char scratch[NUMBER_MAX];
+    char* end = &scratch[sizeof scratch];
+    char* p = digits(end, x);
+    if (negative) {
+        *--p = '-';
+    }
+    fmt_bytes(f, p, (size_t) (end - p));
+}
+
+void
+fmt_dec(struct fmt* f, int64_t const x) {
+    /* the magnitude of INT64_MIN only fits unsigned */
+    uint64_t const mag = x < 0 ? 0 - (uint64_t) x : (uint64_t) x;
+    fmt_unsigned(f, x < 0, mag);
+}
+
+void
+fmt_hex(struct fmt* f, uint64_t x, unsigned const width) {
+    static char const hex[] = "0123456789abcdef";
+
+    char scratch[NUMBER_MAX];
+    char* end = &scratch[sizeof scratch];
+    char* p = end;
+    do {
+        *--p = hex[x & 0xf];
+        x >>= 4;
+    } while (x != 0);
+
+    while ((unsigned) (end - p) < width && p > scratch) {
+        *--p = '0';
+    }
+    fmt_bytes(f, p, (size_t) (end - p));
+}
+
+/*
+ * x / 32 with the given number of decimals, 0 or 1
+ */
+static void
+fmt_q5(struct fmt* f, int64_t const x, bool const decimal) {
+    uint64_t const mag = x < 0 ? 0 - (uint64_t) x : (uint64_t) x;
+    uint64_t whole = mag >> 5;
+    uint64_t const frac = mag & 31;
+
+    /* round the fraction in units of 1/32, ties to even */
+    uint64_t digit = 0;
+    if (decimal) {
+        uint64_t const tenths = frac * 10;
+        uint64_t const rem = tenths & 31;
+        digit = tenths >> 5;
+        if (rem > 16 || (rem == 16 && (digit & 1) != 0)) {
+            digit++;
+        }
+        if (digit == 10) {
+            digit = 0;
+            whole++;
+        }
+    } else if (frac > 16 || (frac == 16 && (whole & 1) != 0)) {
+        whole++;
+    }
+
+    char scratch[NUMBER_MAX];
+    char* end = &scratch[sizeof scratch];
+    char* p = end;
+    if (decimal) {
+        *--p = (char) ('0' + digit);
+        *--p = '.';
+    }
+    p = digits(p, whole);
+
+    /* printf keeps the sign of a negative value that rounds to zero */
+    if (x < 0) {
+        *--p = '-';
+    }
+    fmt_bytes(f, p, (size_t) (end - p));
+}
+
+void
+fmt_q5_1(struct fmt* f, int64_t const x) {
+    fmt_q5(f, x, true);
+}
+
+void
+fmt_q5_0(struct fmt* f, int64_t const x) {
+    fmt_q5(f, x, false);
+}
+
+void
+fmt_f2(struct fmt* f, double const d) {
+#if LDBL_MANT_DIG >= 64
+    double const mag = signbit(d) ? -d : d;
+    if (isfinite(d) && mag < 0x1p62) {
+        /* the whole part and the fraction are exact, so is fraction * 100 */
+        uint64_t whole = (uint64_t) mag;
+        long double const hundredths = ((long double) mag - (long double) whole) * 100;
+        uint64_t cents = (uint64_t) hundredths;
+        long double const rem = hundredths - (long double) cents;
+        if (rem > 0.5L || (rem == 0.5L && (cents & 1) != 0)) {
+            cents++;
+        }
+        if (cents == 100) {
+            cents = 0;
+            whole++;
+        }
+
+        char scratch[NUMBER_MAX];
+        char* end = &scratch[sizeof scratch];
+        char* p = end;
+        *--p = (char) ('0' + cents % 10);
+        *--p = (char) ('0' + cents / 10);
+        *--p = '.';
+        p = digits(p, whole);
+        if (signbit(d)) {
+            *--p = '-';
+        }
+        fmt_bytes(f, p, (size_t) (end - p));
+        return;
+    }
+#endif
+
+    /* huge and non-finite numbers are rare enough for printf */
+    char* p = fmt_room(f, 512);
+    int const n = snprintf(p, 512, "%.2f", d);
+    assert(n > 0 && n < 512);
+    f->len += (size_t) n;
+}
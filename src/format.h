@@ -0,0 +1,105 @@
+/*
+ * format.h: buffered text output
+ */
+
+#ifndef OBSIDIAN_FORMAT_H
+#define OBSIDIAN_FORMAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * size of the buffer in front of a stream
+ */
+#define FMT_BUFFER_SIZE (256u * 1024)
+
+/*
+ * text collected in memory, and written to the sink in large blocks. without
+ * a sink the buffer grows to hold everything.
+ *
+ * The formatters produce exactly what printf would for the same format.
+ */
+struct fmt {
+    char* data;
+    size_t len;
+    size_t capacity;
+    FILE* sink;
+};
+
+struct fmt*
+fmt_init(struct fmt* f, FILE* sink);
+
+/*
+ * writes what is buffered to the sink
+ */
+void
+fmt_flush(struct fmt* f);
+
+/*
+ * flushes and frees the buffer
+ */
+void
+fmt_end(struct fmt* f);
+
+/*
+ * makes room for the given number of bytes, and returns where they go
+ */
+char*
+fmt_room(struct fmt* f, size_t n);
+
+void
+fmt_bytes(struct fmt* f, void const* b, size_t len);
+
+/*
+ * a string literal, without measuring it
+ */
+#define FMT_LITERAL(f, s) fmt_bytes((f), "" s, sizeof(s) - 1)
+
+/*
+ * "%s"
+ */
+void
+fmt_str(struct fmt* f, char const* s);
+
+/*
+ * "%-<width>s"
+ */
+void
+fmt_str_left(struct fmt* f, char const* s, unsigned width);
+
+/*
+ * "%.*s", stops at a NUL like printf does
+ */
+void
+fmt_str_n(struct fmt* f, char const* s, size_t len);
+
+/*
+ * "%d" and "%zu"
+ */
+void
+fmt_dec(struct fmt* f, int64_t x);
+
+/*
+ * "%0<width>x", of an unsigned value
+ */
+void
+fmt_hex(struct fmt* f, uint64_t x, unsigned width);
+
+/*
+ * "%.2f"
+ */
+void
+fmt_f2(struct fmt* f, double d);
+
+/*
+ * "%.1f" and "%1.f" of x / 32, without going through a double
+ */
+void
+fmt_q5_1(struct fmt* f, int64_t x);
+
+void
+fmt_q5_0(struct fmt* f, int64_t x);
+
+#endif //OBSIDIAN_FORMAT_H
@@ -2,12 +2,18 @@
  * buffer.c: packet buffer utility
  */
 
+#define _GNU_SOURCE
+
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "buffer.h"
+#include "pool.h"
 
 #define write_head(r) (&r->data[r->cur])
 #define write_avail(r) (r-> capacity - r->cur)
@@ -17,28 +23,133 @@ pkt_buffer_init(struct pkt_buffer* r, size_t const sz) {
     assert(r != NULL);
     assert(sz > 0);
 
-    uint8_t* buffer = malloc(sz);
+    /* the whole size class is ours to use */
+    size_t size;
+    uint8_t* buffer = pkt_pool_alloc(sz, &size);
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    *r = (struct pkt_buffer){
+        .data = buffer,
+        .capacity = size,
+        .overflow = false,
+        .kind = PKT_BUFFER_HEAP,
+        .size = size,
+        .min_size = size,
+        .max_size = size > PKT_BUFFER_MAX_SIZE ? size : PKT_BUFFER_MAX_SIZE,
+    };
+    return buffer;
+}
+
+/*
+ * maps a ring of the given size twice back to back
+ */
+static uint8_t*
+map_mirrored(size_t const size) {
+    int const fd = memfd_create("pkt_buffer", MFD_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (ftruncate(fd, (off_t) size) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    /* reserve the address space for both mappings first */
+    uint8_t* const base = mmap(NULL, 2 * size, PROT_NONE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    /* then map the ring into both halves */
+    int const prot = PROT_READ | PROT_WRITE;
+    int const flags = MAP_SHARED | MAP_FIXED;
+    if (mmap(base, size, prot, flags, fd, 0) == MAP_FAILED
+        || mmap(base + size, size, prot, flags, fd, 0) == MAP_FAILED) {
+        munmap(base, 2 * size);
+        close(fd);
+        return NULL;
+    }
+
+    /* the mappings keep the memory alive */
+    close(fd);
+    return base;
+}
+
+uint8_t*
+pkt_buffer_init_mirrored(struct pkt_buffer* r, size_t const sz) {
+    assert(r != NULL);
+    assert(sz > 0);
+
+    /* both mappings have to be page aligned */
+    size_t const page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t const size = (sz + page - 1) / page * page;
+
+    uint8_t* buffer = map_mirrored(size);
     if (buffer == NULL) {
         return NULL;
     }
 
     *r = (struct pkt_buffer){
         .data = buffer,
-        .capacity = sz,
+        .capacity = size,
         .overflow = false,
+        .kind = PKT_BUFFER_MIRRORED,
+        .size = size,
+        .min_size = size,
+        .max_size = size > PKT_BUFFER_MAX_SIZE ? size : PKT_BUFFER_MAX_SIZE,
     };
     return buffer;
 }
 
+void
+pkt_buffer_limit(struct pkt_buffer* r, size_t const min, size_t const max) {
+    assert(r != NULL);
+    assert(min > 0);
+    assert(min <= max);
+
+    r->min_size = min;
+    r->max_size = max;
+}
+
 void
 pkt_buffer_end(struct pkt_buffer* r) {
     assert(r != NULL);
     assert(r->data != NULL);
 
-    free(r->data);
+    if (r->kind == PKT_BUFFER_MIRRORED) {
+        munmap(r->data, 2 * r->size);
+    } else {
+        pkt_pool_free(r->data, r->size);
+    }
     r->data = NULL;
 }
 
+/*
+ * halves a grown buffer once it has stayed mostly empty for a while
+ */
+static void
+shrink_idle(struct pkt_buffer* r) {
+    /* a quarter full or less counts as idle */
+    if (r->size <= r->min_size || r->cur - r->pos > r->size / 4) {
+        r->idle = 0;
+        return;
+    }
+
+    if (++r->idle < PKT_BUFFER_IDLE_DROPS) {
+        return;
+    }
+
+    /* failing to shrink only means we keep the larger buffer */
+    size_t const half = r->size / 2;
+    r->idle = 0;
+    pkt_buffer_resize(r, half > r->min_size ? half : r->min_size);
+}
+
 size_t
 pkt_buffer_drop(struct pkt_buffer* r) {
     assert(r != NULL);
@@ -46,6 +157,18 @@ pkt_buffer_drop(struct pkt_buffer* r) {
     assert(r->pos <= r->cur);
     assert(r->cur <= r->capacity);
 
+    /* the ring only has to move its cursors back into the first mapping */
+    if (r->kind == PKT_BUFFER_MIRRORED) {
+        size_t const drop = r->pos + r->size - r->capacity;
+        if (r->pos >= r->size) {
+            r->pos -= r->size;
+            r->cur -= r->size;
+        }
+        r->capacity = r->pos + r->size;
+        shrink_idle(r);
+        return drop;
+    }
+
     /* calculate how much to drop, and what to keep */
     size_t const drop = r->pos;
     size_t const keep = r->cur - r->pos;
@@ -55,6 +178,7 @@ pkt_buffer_drop(struct pkt_buffer* r) {
     memmove(r->data, tail, keep);
     r->pos = 0;
     r->cur = keep;
+    shrink_idle(r);
     return drop;
 }
 
@@ -62,20 +186,68 @@ uint8_t*
 pkt_buffer_resize(struct pkt_buffer* r, size_t const sz) {
     assert(r != NULL);
     assert(r->data != NULL);
-    assert(r->capacity < sz);
+    assert(r->cur - (r->kind == PKT_BUFFER_MIRRORED ? r->pos : 0) <= sz);
+
+    /* a ring is remapped, with the unread bytes moved to its start */
+    if (r->kind == PKT_BUFFER_MIRRORED) {
+        struct pkt_buffer moved;
+        if (pkt_buffer_init_mirrored(&moved, sz) == NULL) {
+            return NULL;
+        }
+
+        size_t const keep = r->cur - r->pos;
+        memcpy(moved.data, &r->data[r->pos], keep);
+        munmap(r->data, 2 * r->size);
+
+        r->data = moved.data;
+        r->pos = 0;
+        r->cur = keep;
+        r->capacity = moved.capacity;
+        r->size = moved.size;
+        return r->data;
+    }
 
     /* allocate a new buffer */
-    uint8_t* new = realloc(r->data, sz);
+    size_t size;
+    uint8_t* new = pkt_pool_alloc(sz, &size);
     if (new == NULL) {
         return NULL;
     }
 
+    /* move the bytes over, and give the old buffer back to the pool */
+    memcpy(new, r->data, r->cur);
+    pkt_pool_free(r->data, r->size);
+
     /* update the state */
     r->data = new;
-    r->capacity = sz;
+    r->capacity = size;
+    r->size = size;
     return r->data;
 }
 
+uint8_t*
+pkt_buffer_reserve(struct pkt_buffer* r, size_t const sz) {
+    assert(r != NULL);
+    assert(r->data != NULL);
+
+    if (sz <= r->size) {
+        return r->data;
+    }
+
+    if (sz > r->max_size) {
+        return NULL;
+    }
+
+    /* double until it fits, so a run of growing packets reallocates rarely */
+    size_t grown = r->size;
+    while (grown < sz) {
+        grown = grown > r->max_size / 2 ? r->max_size : grown * 2;
+    }
+
+    r->idle = 0;
+    return pkt_buffer_resize(r, grown);
+}
+
 size_t
 pkt_buffer_fread(struct pkt_buffer* r, FILE* strm) {
     assert(r != NULL);
@@ -92,3 +264,16 @@ pkt_buffer_fread(struct pkt_buffer* r, FILE* strm) {
     r->cur += got;
     return got;
 }
+
+ssize_t
+pkt_buffer_read(struct pkt_buffer* r, int const fd) {
+    assert(r != NULL);
+    assert(r->data != NULL);
+    assert(r->cur <= r->capacity);
+
+    ssize_t const got = read(fd, write_head(r), write_avail(r));
+    if (got > 0) {
+        r->cur += (size_t) got;
+    }
+    return got;
+}
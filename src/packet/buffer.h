@@ -9,11 +9,40 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/uio.h>
 
 #include "types.h"
 
+/*
+ * returned by readers that do not know the packet id
+ */
+#define PKT_UNKNOWN SIZE_MAX
+
+/*
+ * default limit on how far a packet buffer grows
+ */
+#define PKT_BUFFER_MAX_SIZE (16u * 1024 * 1024)
+
+/*
+ * drops in a row that leave a buffer mostly empty before it shrinks
+ */
+#define PKT_BUFFER_IDLE_DROPS 64
+
+/*
+ * how the memory of a packet buffer is held
+ */
+enum pkt_buffer_kind {
+    PKT_BUFFER_HEAP,
+    PKT_BUFFER_MIRRORED, /* ring mapped twice back to back */
+};
+
 /*
  * buffer that can be read from and written to
+ *
+ * a mirrored buffer maps the same pages twice in a row, so the bytes between
+ * the cursors are always contiguous even when they wrap around the ring. the
+ * read cursor stays within the first mapping and the capacity moves along
+ * with it, so the readers and writers work on both kinds unchanged.
  */
 struct pkt_buffer {
     uint8_t* data;
@@ -23,6 +52,24 @@ struct pkt_buffer {
     size_t in_total;
     size_t out_total;
     bool overflow; /* true if buffer is too small */
+    enum pkt_buffer_kind kind;
+    size_t size; /* size of the allocation, or of one mapping */
+    size_t min_size; /* never shrinks below this */
+    size_t max_size; /* never grows beyond this */
+    unsigned idle; /* drops in a row that left the buffer mostly empty */
+};
+
+/*
+ * scatter-gather list over a packet buffer, large payloads are referenced
+ * in place instead of being copied into the buffer. the buffer must not be
+ * moved or dropped until the list has been sent.
+ */
+struct pkt_iovec {
+    struct iovec* iov;
+    size_t count;
+    size_t capacity;
+    size_t mark; /* start of the buffered bytes not yet in the list */
+    size_t bytes; /* referenced payload bytes */
 };
 
 /*
@@ -31,6 +78,12 @@ struct pkt_buffer {
 uint8_t*
 pkt_buffer_init(struct pkt_buffer* r, size_t sz);
 
+/*
+ * initializes a mirrored packet buffer, the size is rounded up to whole pages
+ */
+uint8_t*
+pkt_buffer_init_mirrored(struct pkt_buffer* r, size_t sz);
+
 /*
  * releases all resources held by a packet buffer
  */
@@ -38,82 +91,123 @@ void
 pkt_buffer_end(struct pkt_buffer* r);
 
 /*
- * drops all data before the read cursor
+ * sets the size a buffer shrinks back to and the size it can grow to
+ */
+void
+pkt_buffer_limit(struct pkt_buffer* r, size_t min, size_t max);
+
+/*
+ * drops all data before the read cursor, a mirrored buffer only moves its
+ * cursors instead of moving the data. a grown buffer that stays mostly empty
+ * is halved again, down to its minimum size.
  */
 size_t
 pkt_buffer_drop(struct pkt_buffer* r);
 
 /*
- * resizes the packet buffer
+ * resizes the packet buffer, keeping the unread bytes
  */
 uint8_t*
 pkt_buffer_resize(struct pkt_buffer* r, size_t sz);
 
+/*
+ * ensures the buffer holds at least the given size, growing geometrically.
+ * returns NULL if that would exceed the maximum size or allocation fails.
+ */
+uint8_t*
+pkt_buffer_reserve(struct pkt_buffer* r, size_t sz);
+
 /*
  * reads as many bytes as possible from a stream into the buffer
  */
 size_t
 pkt_buffer_fread(struct pkt_buffer* r, FILE* strm);
 
-size_t
-read_packet_id(struct pkt_buffer* r, mc_byte* id);
-
-size_t
-read_srv_pkt_auth(struct pkt_buffer* r, struct srv_pkt_auth* pkt);
-
-size_t
-read_srv_pkt_message(struct pkt_buffer* r, struct srv_pkt_message* pkt);
-
-size_t
-read_srv_pkt_full_position(struct pkt_buffer* r,
-                           struct srv_pkt_full_position* pkt);
-
-size_t
-read_srv_pkt_ent_hold_item(struct pkt_buffer* r, struct srv_pkt_ent_hold_item* pkt);
-
-size_t
-read_srv_pkt_receive_item(struct pkt_buffer* r, struct srv_pkt_receive_item* pkt);
-
-size_t
-read_srv_pkt_ent_animation(struct pkt_buffer* r, struct srv_pkt_ent_animation* pkt);
-
-size_t
-read_srv_pkt_spawn_player(struct pkt_buffer* r, struct srv_pkt_spawn_player* pkt);
-
-size_t
-read_srv_pkt_spawn_item(struct pkt_buffer* r, struct srv_pkt_spawn_item* pkt);
+/*
+ * reads whatever a file descriptor has ready into the buffer, with a single
+ * read(2). returns what read returned.
+ */
+ssize_t
+pkt_buffer_read(struct pkt_buffer* r, int fd);
 
 size_t
-read_srv_pkt_ent_pickup(struct pkt_buffer* r, struct srv_pkt_ent_pickup* pkt);
+read_packet_id(struct pkt_buffer* r, mc_byte* id);
 
-size_t
-read_srv_pkt_ent_destroy(struct pkt_buffer* r, struct srv_pkt_ent_destroy* pkt);
+/*
+ * the readers decode a packet payload at the read cursor. they return 0, or
+ * set overflow and return the payload size needed so far. a negative length
+ * field makes them return PKT_UNKNOWN.
+ */
+#define PKT_READER_DECL(PFX, pfx, NAME, name, id, label, print, suffix) \
+    PKT_IF_BARE_##print( \
+        size_t \
+        read_##pfx##_pkt_##name(struct pkt_buffer* r);) \
+    PKT_IF_FIELDS_##print( \
+        size_t \
+        read_##pfx##_pkt_##name(struct pkt_buffer* r, struct pfx##_pkt_##name* pkt);)
 
-size_t
-read_srv_pkt_ent_alive(struct pkt_buffer* r, struct srv_pkt_ent_alive* pkt);
+CLI_PACKETS(PKT_READER_DECL)
+SRV_PACKETS(PKT_READER_DECL)
 
-size_t
-read_srv_ent_move(struct pkt_buffer* r, struct srv_pkt_ent_move* pkt);
-
-size_t
-read_srv_pkt_ent_look(struct pkt_buffer* r, struct srv_pkt_ent_look* pkt);
+/*
+ * the measures give the payload length of a packet from its raw bytes
+ * without decoding it. they return that length when it is at most avail,
+ * otherwise the payload size needed so far, like the readers. a negative
+ * length prefix makes them return PKT_UNKNOWN.
+ *
+ * final is cleared when a length prefix is still missing, the payload is
+ * then larger than the size returned.
+ */
+#define PKT_MEASURE_DECL(PFX, pfx, NAME, name, id, label, print, suffix) \
+    size_t \
+    measure_##pfx##_pkt_##name(mc_byte const* bytes, size_t avail, bool* final);
 
-size_t
-read_srv_pkt_ent_move_look(struct pkt_buffer* r, struct srv_pkt_ent_move_look* pkt);
+CLI_PACKETS(PKT_MEASURE_DECL)
+SRV_PACKETS(PKT_MEASURE_DECL)
 
-size_t
-read_srv_pkt_ent_full_pos(struct pkt_buffer* r, struct srv_pkt_ent_full_pos* pkt);
+/*
+ * the peeks find the entity ids of a packet in its raw bytes without
+ * decoding it, the whole payload has to be there. they store up to
+ * PKT_MAX_ENTITIES of them and return how many. the schema puts entity ids
+ * in front of any byte payload, which is as far as a peek looks.
+ */
+#define PKT_PEEK_DECL(PFX, pfx, NAME, name, id, label, print, suffix) \
+    PKT_IF_FIELDS_##print( \
+        size_t \
+        peek_##pfx##_pkt_##name(mc_byte const* bytes, entity_id* entities);)
 
-size_t
-read_srv_pkt_chunk(struct pkt_buffer* r, struct srv_pkt_chunk* pkt);
+CLI_PACKETS(PKT_PEEK_DECL)
+SRV_PACKETS(PKT_PEEK_DECL)
 
-size_t
-read_srv_pkt_chunk_data(struct pkt_buffer* r, struct srv_pkt_chunk_data* pkt);
+/*
+ * starts a scatter-gather list at the write cursor of a buffer
+ */
+void
+pkt_iovec_init(struct pkt_iovec* v, struct iovec* iov, size_t capacity,
+               struct pkt_buffer const* w);
 
+/*
+ * adds the remaining buffered bytes to the list, returns the iovec count
+ */
 size_t
-read_srv_pkt_0x34(struct pkt_buffer* r);
+pkt_iovec_finish(struct pkt_iovec* v, struct pkt_buffer const* w);
 
-size_t
-read_srv_pkt_0x35(struct pkt_buffer* r);
+/*
+ * the writers encode a whole packet, id included, at the write cursor. they
+ * return 0, or set overflow and return the buffer space the packet needs
+ * when either the buffer or the iovec list is full. payloads are copied when
+ * no iovec list is given.
+ */
+#define PKT_WRITER_DECL(PFX, pfx, NAME, name, id, label, print, suffix) \
+    PKT_IF_BARE_##print( \
+        size_t \
+        write_##pfx##_pkt_##name(struct pkt_buffer* w);) \
+    PKT_IF_FIELDS_##print( \
+        size_t \
+        write_##pfx##_pkt_##name(struct pkt_buffer* w, struct pkt_iovec* v, \
+                                 struct pfx##_pkt_##name const* pkt);)
+
+CLI_PACKETS(PKT_WRITER_DECL)
+SRV_PACKETS(PKT_WRITER_DECL)
 
 #endif //OBSIDIAN_WRITER_H
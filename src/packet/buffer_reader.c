@@ -7,14 +7,6 @@
 #define read_avail(r) (r->cur - r->pos)
 #define read_has(r, n) ((r->pos + n) <= r->cur)
 
-static void
-skip(struct pkt_buffer* r, size_t const cnt) {
-    assert(r != NULL);
-    assert(read_has(r, cnt));
-    r->pos += cnt;
-    r->in_total += cnt;
-}
-
 static mc_byte
 read_byte(struct pkt_buffer* r) {
     assert(r != NULL);
@@ -27,6 +19,114 @@ read_byte(struct pkt_buffer* r) {
     return b;
 }
 
+/*
+ * loads decode a field in place, the caller has checked the whole packet
+ */
+static inline mc_i8
+load_i8(mc_byte const* p) {
+    return (mc_i8) p[0];
+}
+
+static inline mc_i16
+load_i16(mc_byte const* p) {
+    uint16_t x;
+    memcpy(&x, p, sizeof x);
+    return (mc_i16) __builtin_bswap16(x);
+}
+
+static inline mc_i32
+load_i32(mc_byte const* p) {
+    uint32_t x;
+    memcpy(&x, p, sizeof x);
+    return (mc_i32) __builtin_bswap32(x);
+}
+
+static inline mc_i64
+load_i64(mc_byte const* p) {
+    uint64_t x;
+    memcpy(&x, p, sizeof x);
+    return (mc_i64) __builtin_bswap64(x);
+}
+
+static inline mc_f32
+load_f32(mc_byte const* p) {
+    mc_i32 const x = load_i32(p);
+    mc_f32 f;
+    memcpy(&f, &x, sizeof f);
+    return f;
+}
+
+static inline mc_f64
+load_f64(mc_byte const* p) {
+    mc_i64 const x = load_i64(p);
+    mc_f64 d;
+    memcpy(&d, &x, sizeof d);
+    return d;
+}
+
+static inline mc_bool
+load_bool(mc_byte const* p) {
+    assert(p[0] == 0 || p[0] == 1);
+    return p[0] != 0;
+}
+
+static inline entity_id
+load_eid(mc_byte const* p) {
+    mc_i32 const x = load_i32(p);
+    assert(x >= 0);
+    return (entity_id) x;
+}
+
+#define load_f27_5 load_i32
+
+static inline enum animation
+load_anim(mc_byte const* p) {
+    return (enum animation) load_i8(p);
+}
+
+static inline struct mc_c_coords
+load_c_coords(mc_byte const* p) {
+    return (struct mc_c_coords){
+        .x = load_i32(&p[0]),
+        .z = load_i32(&p[4]),
+    };
+}
+
+static inline struct mc_b_coords
+load_b_coords(mc_byte const* p) {
+    return (struct mc_b_coords){
+        .x = load_i32(&p[0]),
+        .y = load_i16(&p[4]),
+        .z = load_i32(&p[6]),
+    };
+}
+
+static inline struct mc_extent
+load_extent(mc_byte const* p) {
+    return (struct mc_extent){
+        .x = load_i8(&p[0]),
+        .y = load_i8(&p[1]),
+        .z = load_i8(&p[2]),
+    };
+}
+
+size_t
+read_packet_id(struct pkt_buffer* r, mc_byte* id) {
+    assert(r != NULL);
+    assert(r->data != NULL);
+    assert(id != NULL);
+
+    if (read_avail(r) < sizeof *id) {
+        r->overflow = true;
+        return sizeof *id;
+    }
+
+    *id = read_byte(r);
+    return 0;
+}
+
+#ifdef PKT_CHECKED_READERS
+
 static mc_i8
 read_i8(struct pkt_buffer* r) {
     assert(r != NULL);
@@ -134,428 +234,245 @@ read_entity_id(struct pkt_buffer* r) {
     return (entity_id) x;
 }
 
-size_t
-read_packet_id(struct pkt_buffer* r, mc_byte* id) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(id != NULL);
-
-    if (read_avail(r) < sizeof *id) {
-        r->overflow = true;
-        return sizeof *id;
-    }
+/* readers for the remaining schema types */
+#define read_eid read_entity_id
+#define read_f27_5 read_i32
 
-    *id = read_byte(r);
-    return 0;
+static enum animation
+read_anim(struct pkt_buffer* r) {
+    return (enum animation) read_i8(r);
 }
 
-size_t
-read_srv_pkt_auth(struct pkt_buffer* r, struct srv_pkt_auth* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (read_avail(r) < SRV_PKT_AUTH_SIZE) {
-        r->overflow = true;
-        return SRV_PKT_AUTH_SIZE;
-    }
-
-    *pkt = (struct srv_pkt_auth){
-        .unknown0 = read_i32(r),
-        .unknown1 = read_i32(r),
-    };
-    return 0;
+static struct mc_c_coords
+read_c_coords(struct pkt_buffer* r) {
+    struct mc_c_coords c;
+    c.x = read_i32(r);
+    c.z = read_i32(r);
+    return c;
 }
 
-size_t
-read_srv_pkt_message(struct pkt_buffer* r, struct srv_pkt_message* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    /* need at least the message length */
-    if (!read_has(r, SRV_PKT_MESSAGE_MIN_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_MESSAGE_MIN_SIZE;
-    }
-
-    /* do we have the full string available? */
-    mc_i16 const len = read_i16(r);
-    if (read_avail(r) < len) {
-        r->overflow = true;
-        return SRV_PKT_MESSAGE_MIN_SIZE + len;
-    }
-
-    *pkt = (struct srv_pkt_message){
-        .length = len,
-        .bytes = read_bytes(r, len),
-    };
-    return 0;
+static struct mc_b_coords
+read_b_coords(struct pkt_buffer* r) {
+    struct mc_b_coords c;
+    c.x = read_i32(r);
+    c.y = read_i16(r);
+    c.z = read_i32(r);
+    return c;
 }
 
-size_t
-read_srv_pkt_full_position(struct pkt_buffer* r,
-                           struct srv_pkt_full_position* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_FULL_POSITION_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_FULL_POSITION_SIZE;
-    }
-
-    *pkt = (struct srv_pkt_full_position){
-        .x = read_f64(r),
-        .head_y = read_f64(r),
-        .y = read_f64(r),
-        .z = read_f64(r),
-        .rotation = read_f32(r),
-        .head_pitch = read_f32(r),
-        .grounded = read_bool(r),
-    };
-    return 0;
-}
-
-size_t
-read_srv_pkt_ent_hold_item(struct pkt_buffer* r, struct srv_pkt_ent_hold_item* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_ENT_HOLD_ITEM_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_ENT_HOLD_ITEM_SIZE;
-    }
-
-    *pkt = (struct srv_pkt_ent_hold_item){
-        .entity = read_entity_id(r),
-        .item = read_i16(r),
-    };
-    return 0;
+static struct mc_extent
+read_extent(struct pkt_buffer* r) {
+    struct mc_extent e;
+    e.x = read_i8(r);
+    e.y = read_i8(r);
+    e.z = read_i8(r);
+    return e;
 }
 
-size_t
-read_srv_pkt_receive_item(struct pkt_buffer* r, struct srv_pkt_receive_item* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_RECEIVE_ITEM_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_RECEIVE_ITEM_SIZE;
-    }
-
-    *pkt = (struct srv_pkt_receive_item){
-        .item = read_i16(r),
-        .count = read_i8(r),
-        .durability = read_i16(r),
-    };
-    return 0;
+/*
+ * whether a payload, and the given number of bytes after it, are available
+ */
+static bool
+read_has_payload(struct pkt_buffer* r, size_t const len, size_t const rest) {
+    return len <= read_avail(r) && rest <= read_avail(r) - len;
 }
 
-size_t
-read_srv_pkt_ent_animation(struct pkt_buffer* r, struct srv_pkt_ent_animation* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_RECEIVE_ITEM_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_ENT_ANIMATION_SIZE;
-    }
-
-    *pkt = (struct srv_pkt_ent_animation){
-        .entity = read_entity_id(r),
-        .animation = read_i8(r),
-    };
-    return 0;
+/*
+ * checked readers decode field by field through the cursor, asserting every
+ * read, which is what the fuzzers want
+ */
+#define READ_F(type, name, prefix, style) \
+    pkt->name = read_##type(r); \
+    seen += PKT_SIZE_##type;
+
+#define READ_V(name, length, scale, prefix, style) \
+    if (pkt->length < 0) { \
+        return PKT_UNKNOWN; \
+    } \
+    \
+    wanted += (size_t) pkt->length * scale; \
+    if (!read_has_payload(r, (size_t) pkt->length * scale, size - seen)) { \
+        r->overflow = true; \
+        return wanted; \
+    } \
+    pkt->name = read_bytes(r, (size_t) pkt->length * scale);
+
+#define READER(PFX, pfx, NAME, name, id, label, print, suffix) \
+    PKT_IF_BARE_##print( \
+        size_t \
+        read_##pfx##_pkt_##name(struct pkt_buffer* r) { \
+            assert(r != NULL); \
+            return 0; \
+        }) \
+    PKT_IF_FIELDS_##print( \
+        size_t \
+        read_##pfx##_pkt_##name(struct pkt_buffer* r, struct pfx##_pkt_##name* pkt) { \
+            assert(r != NULL); \
+            assert(r->data != NULL); \
+            assert(pkt != NULL); \
+            \
+            size_t const size = PFX##_PKT_##NAME##_SIZE; \
+            if (!read_has(r, size)) { \
+                r->overflow = true; \
+                return size; \
+            } \
+            \
+            size_t wanted = size; \
+            size_t seen = 0; \
+            PKT_FIELDS(PFX, NAME, READ_F, READ_V) \
+            (void) wanted; \
+            (void) seen; \
+            return 0; \
+        })
+
+#else
+
+/*
+ * whether a payload, and the given number of bytes after it, are available
+ * to a packet being decoded at p
+ */
+static bool
+load_has_payload(struct pkt_buffer* r, mc_byte const* p,
+                 size_t const len, size_t const rest) {
+    size_t const avail = r->cur - (size_t) (p - r->data);
+    return len <= avail && rest <= avail - len;
 }
 
-size_t
-read_srv_pkt_spawn_player(struct pkt_buffer* r, struct srv_pkt_spawn_player* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_SPAWN_PLAYER_MIN_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_SPAWN_PLAYER_MIN_SIZE;
-    }
-
-    entity_id const eid = read_entity_id(r);
-    mc_i16 const name_length = read_i16(r);
-
-    if (!read_has(r, name_length + 16)) {
-        r->overflow = true;
-        return SRV_PKT_SPAWN_PLAYER_MIN_SIZE;
+/*
+ * fast readers decode from a local pointer and move the cursor once, a
+ * packet that overflows leaves the cursor where it was
+ */
+#define READ_F(type, name, prefix, style) \
+    pkt->name = load_##type(p); \
+    p += PKT_SIZE_##type; \
+    seen += PKT_SIZE_##type;
+
+#define READ_V(name, length, scale, prefix, style) \
+    if (pkt->length < 0) { \
+        return PKT_UNKNOWN; \
+    } \
+    \
+    wanted += (size_t) pkt->length * scale; \
+    if (!load_has_payload(r, p, (size_t) pkt->length * scale, size - seen)) { \
+        r->overflow = true; \
+        return wanted; \
+    } \
+    pkt->name = p; \
+    p += (size_t) pkt->length * scale;
+
+#define READER(PFX, pfx, NAME, name, id, label, print, suffix) \
+    PKT_IF_BARE_##print( \
+        size_t \
+        read_##pfx##_pkt_##name(struct pkt_buffer* r) { \
+            assert(r != NULL); \
+            return 0; \
+        }) \
+    PKT_IF_FIELDS_##print( \
+        size_t \
+        read_##pfx##_pkt_##name(struct pkt_buffer* r, struct pfx##_pkt_##name* pkt) { \
+            assert(r != NULL); \
+            assert(r->data != NULL); \
+            assert(pkt != NULL); \
+            \
+            size_t const size = PFX##_PKT_##NAME##_SIZE; \
+            if (!read_has(r, size)) { \
+                r->overflow = true; \
+                return size; \
+            } \
+            \
+            mc_byte const* p = read_head(r); \
+            size_t wanted = size; \
+            size_t seen = 0; \
+            PKT_FIELDS(PFX, NAME, READ_F, READ_V) \
+            (void) wanted; \
+            (void) seen; \
+            \
+            size_t const n = (size_t) (p - read_head(r)); \
+            r->pos += n; \
+            r->in_total += n; \
+            return 0; \
+        })
+
+#endif
+
+CLI_PACKETS(READER)
+SRV_PACKETS(READER)
+
+/*
+ * the length oracle only loads the length prefixes of a packet, the offset
+ * and width of every field are kept so that a payload can find its prefix
+ */
+#define LENGTH_F(type, name, prefix, style) \
+    size_t const at_##name = at; \
+    size_t const width_##name = PKT_SIZE_##type; \
+    (void) at_##name; \
+    (void) width_##name; \
+    at += PKT_SIZE_##type;
+
+#define LENGTH_V(name, length, scale, prefix, style) \
+    if (avail < at_##length + width_##length) { \
+        *final = false; \
+        return wanted; \
+    } \
+    \
+    mc_i32 const len_##name = width_##length == PKT_SIZE_i16 \
+                              ? load_i16(&bytes[at_##length]) \
+                              : load_i32(&bytes[at_##length]); \
+    if (len_##name < 0) { \
+        return PKT_UNKNOWN; \
+    } \
+    wanted += (size_t) len_##name * scale; \
+    at += (size_t) len_##name * scale;
+
+#define MEASURE(PFX, pfx, NAME, name, id, label, print, suffix) \
+    size_t \
+    measure_##pfx##_pkt_##name(mc_byte const* bytes, size_t const avail, \
+                               bool* final) { \
+        assert(bytes != NULL || avail == 0); \
+        assert(final != NULL); \
+        \
+        *final = true; \
+        size_t wanted = PFX##_PKT_##NAME##_SIZE; \
+        size_t at = 0; \
+        PKT_FIELDS(PFX, NAME, LENGTH_F, LENGTH_V) \
+        (void) bytes; \
+        (void) avail; \
+        (void) at; \
+        return wanted; \
     }
 
-    *pkt = (struct srv_pkt_spawn_player){
-        .entity = eid,
-        .name_length = name_length,
-        .name = read_bytes(r, name_length),
-        .x = read_i32(r),
-        .y = read_i32(r),
-        .z = read_i32(r),
-        .yaw = read_i8(r),
-        .pitch = read_i8(r),
-        .item = read_i16(r),
-    };
-    return 0;
-}
-
-size_t
-read_srv_pkt_spawn_item(struct pkt_buffer* r, struct srv_pkt_spawn_item* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_SPAWN_ITEM_SIZE)) {
-        r->overflow = true;
-    }
-
-    /* no overflow means this gets skipped */
-    *pkt = (struct srv_pkt_spawn_item){
-        .entity = read_entity_id(r),
-        .item = read_i16(r),
-        .count = read_i8(r),
-        .x = read_i32(r),
-        .y = read_i32(r),
-        .z = read_i32(r),
-        .yaw = read_i8(r),
-        .pitch = read_i8(r),
-        .unknown = read_i8(r),
-    };
-    return 0;
-}
-
-size_t read_srv_pkt_ent_pickup(struct pkt_buffer* r, struct srv_pkt_ent_pickup* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_ENT_PICKUP_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_ENT_PICKUP_SIZE;
-    }
-
-    *pkt = (struct srv_pkt_ent_pickup){
-        .item = read_entity_id(r),
-        .entity = read_entity_id(r),
-    };
-    return 0;
-}
-
-size_t read_srv_pkt_ent_destroy(struct pkt_buffer* r, struct srv_pkt_ent_destroy* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_ENT_DESTROY_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_ENT_DESTROY_SIZE;
-    }
-
-    *pkt = (struct srv_pkt_ent_destroy){
-        .entity = read_entity_id(r),
-    };
-    return 0;
-}
-
-size_t
-read_srv_pkt_ent_alive(struct pkt_buffer* r, struct srv_pkt_ent_alive* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_ENT_ALIVE_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_ENT_ALIVE_SIZE;
-    }
-
-    *pkt = (struct srv_pkt_ent_alive){
-        .entity = read_entity_id(r),
-    };
-    return 0;
-}
-
-size_t
-read_srv_ent_move(struct pkt_buffer* r, struct srv_pkt_ent_move* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_ENT_MOVE_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_ENT_MOVE_SIZE;
-    }
-
-    *pkt = (struct srv_pkt_ent_move){
-        .id = read_entity_id(r),
-        .x = read_i8(r),
-        .y = read_i8(r),
-        .z = read_i8(r),
-    };
-    return 0;
-}
-
-size_t
-read_srv_pkt_ent_look(struct pkt_buffer* r, struct srv_pkt_ent_look* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_ENT_LOOK_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_ENT_LOOK_SIZE;
-    }
-
-    *pkt = (struct srv_pkt_ent_look){
-        .id = read_entity_id(r),
-        .yaw = read_i8(r),
-        .pitch = read_i8(r),
-    };
-    return 0;
-}
-
-size_t
-read_srv_pkt_ent_move_look(struct pkt_buffer* r, struct srv_pkt_ent_move_look* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_ENT_MOVE_LOOK_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_ENT_MOVE_LOOK_SIZE;
-    }
-
-    *pkt = (struct srv_pkt_ent_move_look){
-        .id = read_entity_id(r),
-        .x = read_i8(r),
-        .y = read_i8(r),
-        .z = read_i8(r),
-        .yaw = read_i8(r),
-        .pitch = read_i8(r),
-    };
-    return 0;
-}
-
-size_t
-read_srv_pkt_ent_full_pos(struct pkt_buffer* r, struct srv_pkt_ent_full_pos* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_ENT_FULL_POS_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_ENT_FULL_POS_SIZE;
-    }
-
-    *pkt = (struct srv_pkt_ent_full_pos){
-        .id = read_entity_id(r),
-        .x = read_i32(r),
-        .y = read_i32(r),
-        .z = read_i32(r),
-        .yaw = read_i8(r),
-        .pitch = read_i8(r),
-    };
-    return 0;
-}
-
-
-size_t
-read_srv_pkt_chunk(struct pkt_buffer* r, struct srv_pkt_chunk* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_CHUNK_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_CHUNK_SIZE;
-    }
-
-    *pkt = (struct srv_pkt_chunk){
-        .chunk.x = read_i32(r),
-        .chunk.z = read_i32(r),
-        .load = read_bool(r),
-    };
-    return 0;
-}
-
-size_t
-read_srv_pkt_chunk_data(struct pkt_buffer* r, struct srv_pkt_chunk_data* pkt) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-    assert(pkt != NULL);
-
-    if (!read_has(r, SRV_PKT_CHUNK_DATA_MIN_SIZE)) {
-        r->overflow = true;
-        return SRV_PKT_CHUNK_DATA_MIN_SIZE;
-    }
-
-    mc_i32 const origin_x = read_i32(r);
-    mc_i16 const origin_y = read_i16(r);
-    mc_i32 const origin_z = read_i32(r);
-
-    /* read chunk extents */
-    mc_i8 const x = read_i8(r);
-    mc_i8 const y = read_i8(r);
-    mc_i8 const z = read_i8(r);
-
-    /* uncompressed data */
-    mc_i32 const compressed_size = read_i32(r);
-    if (read_avail(r) < compressed_size) {
-        r->overflow = true;
-        return SRV_PKT_CHUNK_DATA_MIN_SIZE + compressed_size;
-    }
-
-    *pkt = (struct srv_pkt_chunk_data){
-        .origin.x = origin_x,
-        .origin.y = origin_y,
-        .origin.z = origin_z,
-        .extent.x = x,
-        .extent.y = y,
-        .extent.z = z,
-        .compressed_size = compressed_size,
-        .data = read_bytes(r, compressed_size),
-    };
-    return 0;
-}
-
-size_t
-read_srv_pkt_0x34(struct pkt_buffer* r) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-
-    if (!read_has(r, SRV_PKT_0x34_MIN_SIZE)) {
-        r->overflow = true;
-    }
-
-    skip(r, sizeof(mc_i32) * 2);
-    mc_i16 const count = read_i16(r);
-    size_t const len = count * sizeof(mc_i32);
-
-    /* some kind of variable data here */
-    if (!read_has(r, len)) {
-        r->overflow = true;
-        return SRV_PKT_0x34_MIN_SIZE + len;
-    }
-
-    skip(r, len);
-    return 0;
-}
-
-size_t
-read_srv_pkt_0x35(struct pkt_buffer* r) {
-    assert(r != NULL);
-    assert(r->data != NULL);
-
-    if (!read_has(r, SRV_PKT_0x35_SIZE)) {
-        r->overflow = true;
-    }
-
-    /* no overflow means this gets skipped */
-    skip(r, SRV_PKT_0x35_SIZE);
-    return 0;
-}
+CLI_PACKETS(MEASURE)
+SRV_PACKETS(MEASURE)
+
+/*
+ * the entity peek loads the entity ids from the raw bytes, counting fixed
+ * fields only up to the first payload
+ */
+#define PEEK_F(type, name, prefix, style) \
+    PKT_IF_EID_##type(if (!past_payload) { \
+        assert(count < PKT_MAX_ENTITIES); \
+        entities[count++] = load_eid(&bytes[at]); \
+    }) \
+    at += PKT_SIZE_##type;
+
+#define PEEK_V(name, length, scale, prefix, style) \
+    past_payload = true;
+
+#define PEEK(PFX, pfx, NAME, name, id, label, print, suffix) \
+    PKT_IF_FIELDS_##print( \
+        size_t \
+        peek_##pfx##_pkt_##name(mc_byte const* bytes, entity_id* entities) { \
+            assert(bytes != NULL); \
+            assert(entities != NULL); \
+            \
+            size_t count = 0; \
+            bool past_payload = false; \
+            size_t at = 0; \
+            PKT_FIELDS(PFX, NAME, PEEK_F, PEEK_V) \
+            (void) past_payload; \
+            (void) at; \
+            return count; \
+        })
+
+CLI_PACKETS(PEEK)
+SRV_PACKETS(PEEK)
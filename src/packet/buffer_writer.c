@@ -0,0 +1,280 @@
+#include <assert.h>
+#include <string.h>
+
+#include "buffer.h"
+
+#define write_head(w) (&w->data[w->cur])
+#define write_has(w, n) ((w->cur + n) <= w->capacity)
+
+/*
+ * payloads shorter than this are cheaper to copy than to reference
+ */
+#define PKT_IOVEC_COPY_MAX 64u
+
+static void
+write_byte(struct pkt_buffer* w, mc_byte const b) {
+    assert(w != NULL);
+    assert(w->data != NULL);
+    assert(write_has(w, sizeof b));
+
+    write_head(w)[0] = b;
+    w->cur += sizeof b;
+    w->out_total += sizeof b;
+}
+
+static void
+write_i8(struct pkt_buffer* w, mc_i8 const x) {
+    write_byte(w, (mc_byte) x);
+}
+
+static void
+write_i16(struct pkt_buffer* w, mc_i16 const x) {
+    assert(w != NULL);
+    assert(w->data != NULL);
+    assert(write_has(w, sizeof x));
+
+    /* swap and copy */
+    uint16_t const b = __builtin_bswap16((uint16_t) x);
+    memcpy(write_head(w), &b, sizeof b);
+    w->cur += sizeof b;
+    w->out_total += sizeof b;
+}
+
+static void
+write_i32(struct pkt_buffer* w, mc_i32 const x) {
+    assert(w != NULL);
+    assert(w->data != NULL);
+    assert(write_has(w, sizeof x));
+
+    /* swap and copy */
+    uint32_t const b = __builtin_bswap32((uint32_t) x);
+    memcpy(write_head(w), &b, sizeof b);
+    w->cur += sizeof b;
+    w->out_total += sizeof b;
+}
+
+static void
+write_i64(struct pkt_buffer* w, mc_i64 const x) {
+    assert(w != NULL);
+    assert(w->data != NULL);
+    assert(write_has(w, sizeof x));
+
+    /* swap and copy */
+    uint64_t const b = __builtin_bswap64((uint64_t) x);
+    memcpy(write_head(w), &b, sizeof b);
+    w->cur += sizeof b;
+    w->out_total += sizeof b;
+}
+
+static void
+write_f32(struct pkt_buffer* w, mc_f32 const f) {
+    mc_i32 x;
+
+    /* coerce into integer */
+    memcpy(&x, &f, sizeof x);
+    write_i32(w, x);
+}
+
+static void
+write_f64(struct pkt_buffer* w, mc_f64 const d) {
+    mc_i64 x;
+
+    /* coerce into integer */
+    memcpy(&x, &d, sizeof x);
+    write_i64(w, x);
+}
+
+static void
+write_bool(struct pkt_buffer* w, mc_bool const b) {
+    write_byte(w, b ? 1 : 0);
+}
+
+static void
+write_entity_id(struct pkt_buffer* w, entity_id const id) {
+    assert(id >= 0);
+    write_i32(w, id);
+}
+
+/* writers for the remaining schema types */
+#define write_eid write_entity_id
+#define write_f27_5 write_i32
+
+static void
+write_anim(struct pkt_buffer* w, enum animation const a) {
+    write_i8(w, (mc_i8) a);
+}
+
+static void
+write_c_coords(struct pkt_buffer* w, struct mc_c_coords const c) {
+    write_i32(w, c.x);
+    write_i32(w, c.z);
+}
+
+static void
+write_b_coords(struct pkt_buffer* w, struct mc_b_coords const c) {
+    write_i32(w, c.x);
+    write_i16(w, c.y);
+    write_i32(w, c.z);
+}
+
+static void
+write_extent(struct pkt_buffer* w, struct mc_extent const e) {
+    write_i8(w, e.x);
+    write_i8(w, e.y);
+    write_i8(w, e.z);
+}
+
+/*
+ * bytes of a payload that end up in the buffer itself
+ */
+static size_t
+payload_size(struct pkt_iovec const* v, size_t const len) {
+    return v == NULL || len < PKT_IOVEC_COPY_MAX ? len : 0;
+}
+
+/*
+ * number of iovecs a payload takes up
+ */
+static size_t
+payload_iovecs(struct pkt_iovec const* v, size_t const len) {
+    return payload_size(v, len) == len ? 0 : 2;
+}
+
+/*
+ * checks that a packet fits, or flags the overflow
+ */
+static bool
+write_fits(struct pkt_buffer* w, struct pkt_iovec const* v,
+           size_t const size, size_t const iovecs) {
+    assert(w != NULL);
+    assert(w->data != NULL);
+
+    /* one more iovec is needed to finish the list */
+    if (!write_has(w, size)
+        || (v != NULL && v->count + iovecs >= v->capacity)) {
+        w->overflow = true;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * copies a payload into the buffer, or references it from the iovec list
+ */
+static void
+write_bytes(struct pkt_buffer* w, struct pkt_iovec* v,
+            mc_byte const* b, size_t const len) {
+    assert(w != NULL);
+    assert(w->data != NULL);
+    assert(b != NULL || len == 0);
+
+    if (payload_iovecs(v, len) == 0) {
+        assert(write_has(w, len));
+        if (len > 0) {
+            memcpy(write_head(w), b, len);
+        }
+        w->cur += len;
+        w->out_total += len;
+        return;
+    }
+
+    /* close the buffered run, then point at the payload */
+    assert(v->count + 2 <= v->capacity);
+    if (w->cur > v->mark) {
+        v->iov[v->count++] = (struct iovec){
+            .iov_base = &w->data[v->mark],
+            .iov_len = w->cur - v->mark,
+        };
+    }
+
+    v->iov[v->count++] = (struct iovec){
+        .iov_base = (void*) b,
+        .iov_len = len,
+    };
+    v->mark = w->cur;
+    v->bytes += len;
+    w->out_total += len;
+}
+
+void
+pkt_iovec_init(struct pkt_iovec* v, struct iovec* iov, size_t const capacity,
+               struct pkt_buffer const* w) {
+    assert(v != NULL);
+    assert(iov != NULL);
+    assert(capacity > 0);
+    assert(w != NULL);
+
+    *v = (struct pkt_iovec){
+        .iov = iov,
+        .capacity = capacity,
+        .mark = w->cur,
+    };
+}
+
+size_t
+pkt_iovec_finish(struct pkt_iovec* v, struct pkt_buffer const* w) {
+    assert(v != NULL);
+    assert(w != NULL);
+    assert(v->mark <= w->cur);
+
+    /* the tail of the buffer goes out last */
+    if (w->cur > v->mark) {
+        assert(v->count < v->capacity);
+        v->iov[v->count++] = (struct iovec){
+            .iov_base = &w->data[v->mark],
+            .iov_len = w->cur - v->mark,
+        };
+        v->mark = w->cur;
+    }
+    return v->count;
+}
+
+/*
+ * writers measure the variable payloads first, so a packet that does not fit
+ * leaves the buffer and the iovec list untouched
+ */
+#define MEASURE_F(type, name, prefix, style)
+
+#define MEASURE_V(name, length, scale, prefix, style) \
+    assert(pkt->length >= 0); \
+    size += payload_size(v, (size_t) pkt->length * scale); \
+    iovecs += payload_iovecs(v, (size_t) pkt->length * scale);
+
+#define WRITE_F(type, name, prefix, style) \
+    write_##type(w, pkt->name);
+
+#define WRITE_V(name, length, scale, prefix, style) \
+    write_bytes(w, v, pkt->name, (size_t) pkt->length * scale);
+
+#define WRITER(PFX, pfx, NAME, name, id, label, print, suffix) \
+    PKT_IF_BARE_##print( \
+        size_t \
+        write_##pfx##_pkt_##name(struct pkt_buffer* w) { \
+            size_t const size = sizeof(mc_byte) + PFX##_PKT_##NAME##_SIZE; \
+            if (!write_fits(w, NULL, size, 0)) { \
+                return size; \
+            } \
+            \
+            write_byte(w, PFX##_##NAME); \
+            return 0; \
+        }) \
+    PKT_IF_FIELDS_##print( \
+        size_t \
+        write_##pfx##_pkt_##name(struct pkt_buffer* w, struct pkt_iovec* v, \
+                                 struct pfx##_pkt_##name const* pkt) { \
+            assert(pkt != NULL); \
+            \
+            size_t size = sizeof(mc_byte) + PFX##_PKT_##NAME##_SIZE; \
+            size_t iovecs = 0; \
+            PKT_FIELDS(PFX, NAME, MEASURE_F, MEASURE_V) \
+            if (!write_fits(w, v, size, iovecs)) { \
+                return size; \
+            } \
+            \
+            write_byte(w, PFX##_##NAME); \
+            PKT_FIELDS(PFX, NAME, WRITE_F, WRITE_V) \
+            return 0; \
+        })
+
+CLI_PACKETS(WRITER)
+SRV_PACKETS(WRITER)
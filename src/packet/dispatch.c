@@ -0,0 +1,162 @@
+/*
+ * dispatch.c: per-id packet tables
+ */
+
+#include <assert.h>
+
+#include "dispatch.h"
+
+/*
+ * decoders share one signature, whatever the packet
+ */
+#define DECODER(PFX, pfx, NAME, name, id, label, print, suffix) \
+    static size_t \
+    decode_##pfx##_pkt_##name(struct pkt_buffer* r, void* pkt) { \
+        PKT_IF_BARE_##print((void) pkt; return read_##pfx##_pkt_##name(r);) \
+        PKT_IF_FIELDS_##print(return read_##pfx##_pkt_##name(r, pkt);) \
+    }
+
+CLI_PACKETS(DECODER)
+SRV_PACKETS(DECODER)
+
+/*
+ * entity getters collect the entity id fields of a packet, in order
+ */
+#define ENTITY_F(type, name, prefix, style) \
+    PKT_IF_EID_##type( \
+        assert(count < PKT_MAX_ENTITIES); \
+        entities[count++] = pkt->name;)
+
+#define ENTITY_V(name, length, scale, prefix, style)
+
+#define ENTITY(PFX, pfx, NAME, name, id, label, print, suffix) \
+    PKT_IF_FIELDS_##print( \
+        static size_t \
+        entity_##pfx##_pkt_##name(void const* any, entity_id* entities) { \
+            struct pfx##_pkt_##name const* pkt = any; \
+            size_t count = 0; \
+            PKT_FIELDS(PFX, NAME, ENTITY_F, ENTITY_V) \
+            (void) pkt; \
+            (void) entities; \
+            return count; \
+        })
+
+CLI_PACKETS(ENTITY)
+SRV_PACKETS(ENTITY)
+
+/* the lowercase name is not called name here, it would hit .name */
+#define ENTRY(PFX, pfx, NAME, lower, id, label, print, suffix) \
+    [id] = { \
+        .name = label, \
+        .size = PFX##_PKT_##NAME##_SIZE, \
+        .measure = measure_##pfx##_pkt_##lower, \
+        .decode = decode_##pfx##_pkt_##lower, \
+        PKT_IF_FIELDS_##print(.entity = entity_##pfx##_pkt_##lower,) \
+        PKT_IF_FIELDS_##print(.peek = peek_##pfx##_pkt_##lower,) \
+    },
+
+struct pkt_table const pkt_cli_table = {
+    .entry = {CLI_PACKETS(ENTRY)},
+};
+
+struct pkt_table const pkt_srv_table = {
+    .entry = {SRV_PACKETS(ENTRY)},
+};
+
+void
+pkt_table_register(struct pkt_table* t, mc_byte const id,
+                   pkt_handler const handle) {
+    assert(t != NULL);
+    assert(t->entry[id].decode != NULL);
+
+    t->entry[id].handle = handle;
+}
+
+size_t
+pkt_length(struct pkt_table const* t, mc_byte const id, mc_byte const* bytes,
+           size_t const avail) {
+    bool final;
+    return pkt_length_final(t, id, bytes, avail, &final);
+}
+
+size_t
+pkt_length_final(struct pkt_table const* t, mc_byte const id, mc_byte const* bytes,
+                 size_t const avail, bool* final) {
+    assert(t != NULL);
+    assert(final != NULL);
+
+    pkt_measure const measure = t->entry[id].measure;
+    if (measure == NULL) {
+        *final = true;
+        return PKT_UNKNOWN;
+    }
+    return measure(bytes, avail, final);
+}
+
+size_t
+pkt_peek_entities(struct pkt_table const* t, mc_byte const id, mc_byte const* bytes,
+                  entity_id* entities) {
+    assert(t != NULL);
+
+    pkt_peek const peek = t->entry[id].peek;
+    return peek == NULL ? 0 : peek(bytes, entities);
+}
+
+bool
+pkt_entity_repeated(entity_id const* entities, size_t const i) {
+    assert(entities != NULL);
+
+    for (size_t j = 0; j < i; j++) {
+        if (entities[j] == entities[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t
+pkt_skip(struct pkt_table const* t, struct pkt_buffer* r, mc_byte const id) {
+    assert(t != NULL);
+    assert(r != NULL);
+    assert(r->data != NULL);
+
+    size_t const avail = r->cur - r->pos;
+    size_t const len = pkt_length(t, id, &r->data[r->pos], avail);
+    if (len == PKT_UNKNOWN) {
+        return PKT_UNKNOWN;
+    }
+
+    if (len > avail) {
+        r->overflow = true;
+        return len;
+    }
+
+    r->pos += len;
+    r->in_total += len;
+    return 0;
+}
+
+size_t
+pkt_dispatch(struct pkt_table const* t, struct pkt_buffer* r, mc_byte const id,
+             void* ctx) {
+    assert(t != NULL);
+    assert(r != NULL);
+    assert(r->data != NULL);
+
+    struct pkt_entry const* e = &t->entry[id];
+
+    /* nobody is interested, skip it without decoding */
+    if (e->handle == NULL) {
+        return pkt_skip(t, r, id);
+    }
+
+    union pkt_any pkt;
+    size_t const start = r->in_total;
+    size_t const wanted = e->decode(r, &pkt);
+    if (wanted != 0) {
+        return wanted;
+    }
+
+    e->handle(ctx, id, &pkt, start - sizeof id, r->in_total - start);
+    return 0;
+}
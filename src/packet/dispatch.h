@@ -0,0 +1,130 @@
+/*
+ * dispatch.h: per-id packet tables
+ */
+
+#ifndef OBSIDIAN_DISPATCH_H
+#define OBSIDIAN_DISPATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "buffer.h"
+
+/*
+ * measures a payload from its raw bytes, see the measure_* functions
+ */
+typedef size_t (*pkt_measure)(mc_byte const* bytes, size_t avail, bool* final);
+
+/*
+ * decodes a payload into its packet struct, see the read_* functions
+ */
+typedef size_t (*pkt_decode)(struct pkt_buffer* r, void* pkt);
+
+/*
+ * finds the entities a decoded packet is about, its entity id fields in
+ * order. stores up to PKT_MAX_ENTITIES of them and returns how many. this
+ * is for handlers, which only have the decoded packet, raw bytes are peeked.
+ */
+typedef size_t (*pkt_entity)(void const* pkt, entity_id* entities);
+
+/*
+ * finds the entities of a packet from its raw payload, see the peek_* functions
+ */
+typedef size_t (*pkt_peek)(mc_byte const* bytes, entity_id* entities);
+
+/*
+ * receives a decoded packet, offset is where its id was in the stream and
+ * length is the size of its payload
+ */
+typedef void (*pkt_handler)(void* ctx, mc_byte id, void const* pkt,
+                            size_t offset, size_t length);
+
+struct pkt_entry {
+    char const* name;
+    size_t size; /* fixed part of the payload */
+    pkt_measure measure;
+    pkt_decode decode;
+    pkt_entity entity;
+    pkt_peek peek;
+    pkt_handler handle;
+};
+
+/*
+ * an entry for every possible id, unknown ids have none of the functions
+ *
+ * The tables below are the defaults. A tool that wants its own handlers
+ * copies one and registers them on the copy.
+ */
+struct pkt_table {
+    struct pkt_entry entry[256];
+};
+
+extern struct pkt_table const pkt_cli_table;
+extern struct pkt_table const pkt_srv_table;
+
+/*
+ * large enough for any decoded packet
+ */
+#define PKT_ANY_MEMBER(PFX, pfx, NAME, name, id, label, print, suffix) \
+    PKT_IF_FIELDS_##print(struct pfx##_pkt_##name pfx##_pkt_##name;)
+
+union pkt_any {
+    CLI_PACKETS(PKT_ANY_MEMBER)
+    SRV_PACKETS(PKT_ANY_MEMBER)
+};
+
+/*
+ * sets the handler of a packet, a known id is required
+ */
+void
+pkt_table_register(struct pkt_table* t, mc_byte id, pkt_handler handle);
+
+/*
+ * measures the payload of a packet without decoding it. returns its length
+ * when that is at most avail, otherwise the payload size needed so far, and
+ * PKT_UNKNOWN for unknown packets and negative length prefixes.
+ */
+size_t
+pkt_length(struct pkt_table const* t, mc_byte id, mc_byte const* bytes,
+           size_t avail);
+
+/*
+ * like pkt_length, and clears final when the size returned is not the whole
+ * payload because a length prefix past avail is still missing
+ */
+size_t
+pkt_length_final(struct pkt_table const* t, mc_byte id, mc_byte const* bytes,
+                 size_t avail, bool* final);
+
+/*
+ * finds the entity ids in the complete payload of a packet without decoding
+ * it, stores up to PKT_MAX_ENTITIES of them and returns how many
+ */
+size_t
+pkt_peek_entities(struct pkt_table const* t, mc_byte id, mc_byte const* bytes,
+                  entity_id* entities);
+
+/*
+ * whether an entity id was already among those before it, so a packet that
+ * names one entity twice is only counted once
+ */
+bool
+pkt_entity_repeated(entity_id const* entities, size_t i);
+
+/*
+ * skips the payload of a packet whose id was just read, by its length
+ * alone. follows the overflow contract of the readers.
+ */
+size_t
+pkt_skip(struct pkt_table const* t, struct pkt_buffer* r, mc_byte id);
+
+/*
+ * reads the payload of a packet whose id was just read. a packet with a
+ * handler is decoded and handed to it, any other packet is skipped by its
+ * length. follows the overflow contract of the readers.
+ */
+size_t
+pkt_dispatch(struct pkt_table const* t, struct pkt_buffer* r, mc_byte id,
+             void* ctx);
+
+#endif //OBSIDIAN_DISPATCH_H
@@ -0,0 +1,166 @@
+/*
+ * framer.c: incremental packet framing
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "framer.h"
+
+void
+pkt_framer_init(struct pkt_framer* f, struct pkt_table const* table) {
+    assert(f != NULL);
+
+    *f = (struct pkt_framer){
+        .table = table,
+        .lost = table == NULL,
+    };
+}
+
+static uint8_t*
+stage_of(struct pkt_framer* f) {
+    return f->held != NULL ? f->held : f->stage;
+}
+
+static size_t
+stage_capacity(struct pkt_framer const* f) {
+    return f->held != NULL ? f->held_capacity : PKT_FRAMER_STAGE;
+}
+
+/*
+ * makes the stage hold at least n bytes, keeping the first kept bytes
+ */
+static void
+stage_reserve(struct pkt_framer* f, size_t const n, size_t const kept) {
+    if (n <= stage_capacity(f)) {
+        return;
+    }
+
+    uint8_t* held = realloc(f->held, n);
+    if (held == NULL) {
+        fprintf(stderr, "error: could not allocate %zu bytes to frame a packet\n", n);
+        exit(EXIT_FAILURE);
+    }
+
+    if (f->held == NULL) {
+        memcpy(held, f->stage, kept);
+    }
+    f->held = held;
+    f->held_capacity = n;
+}
+
+/*
+ * forgets the staged start of a packet, the heap is only kept for as long as
+ * the packet that needed it
+ */
+static void
+unstage(struct pkt_framer* f) {
+    free(f->held);
+    f->held = NULL;
+    f->held_capacity = 0;
+    f->staged = 0;
+}
+
+/*
+ * measures one packet at the start of the given bytes, returns 0 and its
+ * length, or the bytes the packet wants in total. final is cleared when the
+ * packet wants more than that, once a length prefix is in.
+ */
+static size_t
+frame_one(struct pkt_framer* f, uint8_t const* data, size_t const len,
+          size_t* length, bool* final) {
+    *final = true;
+    if (len < sizeof(mc_byte)) {
+        return sizeof(mc_byte);
+    }
+
+    mc_byte const id = data[0];
+    size_t const avail = len - sizeof id;
+    size_t const wanted = pkt_length_final(f->table, id, &data[sizeof id], avail, final);
+    if (wanted == PKT_UNKNOWN) {
+        f->lost = true;
+        f->unknown = id;
+        return PKT_UNKNOWN;
+    }
+
+    if (wanted > avail) {
+        return sizeof id + wanted;
+    }
+
+    *length = sizeof id + wanted;
+    return 0;
+}
+
+size_t
+pkt_framer_feed(struct pkt_framer* f, uint8_t const* data, size_t const len) {
+    assert(f != NULL);
+    assert(data != NULL || len == 0);
+
+    size_t off = 0;
+    size_t boundary = 0;
+    while (off < len && !f->lost) {
+        /* skip over the rest of a packet whose length we know */
+        if (f->remaining > 0) {
+            size_t const n = f->remaining < len - off ? f->remaining : len - off;
+            f->remaining -= n;
+            off += n;
+            if (f->remaining == 0) {
+                f->packets++;
+                boundary = off;
+            }
+            continue;
+        }
+
+        /* frame in place, unless the start of the packet was staged */
+        uint8_t const* start = &data[off];
+        size_t avail = len - off;
+        size_t take = avail;
+        if (f->staged > 0) {
+            take = stage_capacity(f) - f->staged;
+            take = take < avail ? take : avail;
+            memcpy(&stage_of(f)[f->staged], start, take);
+            start = stage_of(f);
+            avail = f->staged + take;
+        }
+
+        size_t length;
+        bool final;
+        size_t const wanted = frame_one(f, start, avail, &length, &final);
+        if (wanted == PKT_UNKNOWN) {
+            break;
+        }
+
+        if (wanted == 0) {
+            /* the packet is complete */
+            off += length - f->staged;
+            unstage(f);
+            f->packets++;
+            boundary = off;
+        } else if (final && wanted > PKT_FRAMER_STAGE) {
+            /* the whole length is known, skip the rest */
+            f->remaining = wanted - avail;
+            off += take;
+            unstage(f);
+        } else {
+            /* keep the start of the packet until its length is known */
+            stage_reserve(f, wanted, f->staged > 0 ? avail : 0);
+            if (f->staged == 0) {
+                memcpy(stage_of(f), start, avail);
+            }
+            f->staged = avail;
+            off += take;
+        }
+    }
+
+    /* without boundaries everything is passed through */
+    return f->lost ? len : boundary;
+}
+
+void
+pkt_framer_end(struct pkt_framer* f) {
+    assert(f != NULL);
+
+    unstage(f);
+}
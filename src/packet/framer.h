@@ -0,0 +1,55 @@
+/*
+ * framer.h: incremental packet framing
+ */
+
+#ifndef OBSIDIAN_FRAMER_H
+#define OBSIDIAN_FRAMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dispatch.h"
+
+/*
+ * enough to hold the start of any packet until its length is known
+ */
+#define PKT_FRAMER_STAGE 64
+
+/*
+ * finds packet boundaries in a stream that arrives in arbitrary pieces
+ *
+ * Pieces are never copied, except for the first bytes of a packet that is
+ * split between two pieces before its length is known. A packet with a
+ * length prefix behind a payload, like the handshake, can need more than the
+ * stage before that is known, its start is then held on the heap.
+ */
+struct pkt_framer {
+    struct pkt_table const* table;
+    size_t remaining; /* bytes of the current packet still to come */
+    uint8_t stage[PKT_FRAMER_STAGE];
+    size_t staged;
+    uint8_t* held; /* replaces the stage while it is too small */
+    size_t held_capacity;
+    size_t packets; /* packets framed so far */
+    bool lost; /* an unknown packet was seen, boundaries are unknown */
+    mc_byte unknown; /* id of that packet */
+};
+
+/*
+ * initializes a framer, without a table every byte is passed as is
+ */
+void
+pkt_framer_init(struct pkt_framer* f, struct pkt_table const* table);
+
+/*
+ * feeds the next piece of the stream, returns how many of its bytes belong to
+ * packets that are now complete
+ */
+size_t
+pkt_framer_feed(struct pkt_framer* f, uint8_t const* data, size_t len);
+
+void
+pkt_framer_end(struct pkt_framer* f);
+
+#endif //OBSIDIAN_FRAMER_H
@@ -0,0 +1,331 @@
+/*
+ * index.c: packet index of a capture
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "index.h"
+
+static char const magic[4] = {'O', 'B', 'I', 'X'};
+
+/*
+ * orders entity keys by entity, then by record
+ */
+static int
+compare_keys(void const* a, void const* b) {
+    struct pkt_index_key const* x = a;
+    struct pkt_index_key const* y = b;
+    if (x->entity != y->entity) {
+        return x->entity < y->entity ? -1 : 1;
+    }
+    return x->record < y->record ? -1 : x->record > y->record;
+}
+
+/*
+ * the header fields that tie an index to its capture
+ */
+static struct pkt_index_header
+capture_header(struct stat const* capture) {
+    return (struct pkt_index_header){
+        .capture_size = (uint64_t) capture->st_size,
+        .capture_inode = (uint64_t) capture->st_ino,
+        .capture_mtime_sec = (int64_t) capture->st_mtim.tv_sec,
+        .capture_mtime_nsec = (int64_t) capture->st_mtim.tv_nsec,
+    };
+}
+
+/*
+ * points the lookups of an index at its layout in the given memory
+ */
+static void
+index_layout(struct pkt_index* idx, void* map, size_t const size, bool const mapped) {
+    idx->map = map;
+    idx->map_size = size;
+    idx->mapped = mapped;
+    idx->header = map;
+    idx->records = (struct pkt_index_record const*) &idx->header[1];
+    idx->by_entity = (struct pkt_index_key const*) &idx->records[idx->header->count];
+}
+
+/*
+ * the record and key arrays grow geometrically while a capture is walked
+ */
+static size_t
+grown_capacity(size_t capacity, size_t const needed) {
+    while (capacity < needed) {
+        capacity = capacity == 0 ? 4096 : capacity * 2;
+    }
+    return capacity;
+}
+
+static bool
+reserve_records(struct pkt_index_record** records, size_t* capacity, size_t const needed) {
+    if (needed <= *capacity) {
+        return true;
+    }
+
+    size_t const wanted = grown_capacity(*capacity, needed);
+    struct pkt_index_record* grown = realloc(*records, wanted * sizeof *grown);
+    if (grown == NULL) {
+        return false;
+    }
+    *records = grown;
+    *capacity = wanted;
+    return true;
+}
+
+static bool
+reserve_keys(struct pkt_index_key** keys, size_t* capacity, size_t const needed) {
+    if (needed <= *capacity) {
+        return true;
+    }
+
+    size_t const wanted = grown_capacity(*capacity, needed);
+    struct pkt_index_key* grown = realloc(*keys, wanted * sizeof *grown);
+    if (grown == NULL) {
+        return false;
+    }
+    *keys = grown;
+    *capacity = wanted;
+    return true;
+}
+
+bool
+pkt_index_build(struct pkt_index* idx, struct pkt_table const* t, uint8_t const* data,
+                size_t const size, struct stat const* capture) {
+    assert(idx != NULL);
+    assert(t != NULL);
+    assert(data != NULL || size == 0);
+    assert(capture != NULL);
+
+    *idx = (struct pkt_index){0};
+
+    struct pkt_index_record* records = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    struct pkt_index_key* keys = NULL;
+    size_t key_count = 0;
+    size_t key_capacity = 0;
+
+    /* walk the capture, the entities are peeked from the raw bytes */
+    size_t off = 0;
+    while (off < size) {
+        mc_byte const id = data[off];
+        size_t const avail = size - off - sizeof id;
+        size_t const len = pkt_length(t, id, &data[off + sizeof id], avail);
+        if (len == PKT_UNKNOWN || len > avail) {
+            break;
+        }
+
+        entity_id entities[PKT_MAX_ENTITIES];
+        size_t const n = pkt_peek_entities(t, id, &data[off + sizeof id], entities);
+
+        if (!reserve_records(&records, &capacity, count + 1)
+            || !reserve_keys(&keys, &key_capacity, key_count + n)) {
+            free(records);
+            free(keys);
+            return false;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            if (!pkt_entity_repeated(entities, i)) {
+                keys[key_count++] = (struct pkt_index_key){
+                    .record = count,
+                    .entity = entities[i],
+                };
+            }
+        }
+
+        records[count++] = (struct pkt_index_record){
+            .offset = off,
+            .id = id,
+        };
+        off += sizeof id + len;
+    }
+
+    /* the index is laid out in memory as it is in its file */
+    size_t const map_size = sizeof(struct pkt_index_header) + count * sizeof *records
+                            + key_count * sizeof *keys;
+    uint8_t* map = malloc(map_size);
+    if (map == NULL) {
+        free(records);
+        free(keys);
+        return false;
+    }
+
+    if (key_count > 0) {
+        qsort(keys, key_count, sizeof *keys, compare_keys);
+    }
+
+    struct pkt_index_header header = capture_header(capture);
+    header.version = PKT_INDEX_VERSION;
+    header.count = count;
+    header.keys = key_count;
+    header.end = off;
+    memcpy(header.magic, magic, sizeof magic);
+    memcpy(map, &header, sizeof header);
+    if (count > 0) {
+        memcpy(&map[sizeof header], records, count * sizeof *records);
+    }
+    if (key_count > 0) {
+        memcpy(&map[sizeof header + count * sizeof *records], keys, key_count * sizeof *keys);
+    }
+    free(records);
+    free(keys);
+    index_layout(idx, map, map_size, false);
+    return true;
+}
+
+bool
+pkt_index_write(struct pkt_index const* idx, char const* path) {
+    assert(idx != NULL);
+    assert(idx->map != NULL);
+    assert(path != NULL);
+
+    /* a reader may have the old index mapped, so it is replaced, not truncated */
+    char temp[4096];
+    if ((size_t) snprintf(temp, sizeof temp, "%s.XXXXXX", path) >= sizeof temp) {
+        return false;
+    }
+
+    int const fd = mkstemp(temp);
+    if (fd < 0) {
+        return false;
+    }
+
+    /* readable by all like any other file, mkstemp leaves it private */
+    FILE* file = NULL;
+    if (fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == 0) {
+        file = fdopen(fd, "wb");
+    }
+    if (file == NULL) {
+        close(fd);
+        unlink(temp);
+        return false;
+    }
+
+    bool ok = fwrite(idx->map, 1, idx->map_size, file) == idx->map_size;
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(temp, path) == 0;
+    if (!ok) {
+        unlink(temp);
+    }
+    return ok;
+}
+
+bool
+pkt_index_open(struct pkt_index* idx, char const* path, struct stat const* capture) {
+    assert(idx != NULL);
+    assert(path != NULL);
+    assert(capture != NULL);
+
+    *idx = (struct pkt_index){0};
+
+    int const fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(struct pkt_index_header)) {
+        close(fd);
+        return false;
+    }
+
+    size_t const size = (size_t) st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    /* the sizes have to add up before anything is trusted */
+    struct pkt_index_header const* header = map;
+    struct pkt_index_header const want = capture_header(capture);
+    size_t const count = (size_t) header->count;
+    size_t const keys = (size_t) header->keys;
+    size_t const room = size - sizeof *header;
+    if (memcmp(header->magic, magic, sizeof magic) != 0
+        || header->version != PKT_INDEX_VERSION
+        || header->capture_size != want.capture_size
+        || header->capture_inode != want.capture_inode
+        || header->capture_mtime_sec != want.capture_mtime_sec
+        || header->capture_mtime_nsec != want.capture_mtime_nsec
+        || count > room / sizeof(struct pkt_index_record)
+        || keys > room / sizeof(struct pkt_index_key)
+        || room != count * sizeof(struct pkt_index_record)
+                        + keys * sizeof(struct pkt_index_key)) {
+        munmap(map, size);
+        return false;
+    }
+
+    index_layout(idx, map, size, true);
+    return true;
+}
+
+void
+pkt_index_close(struct pkt_index* idx) {
+    assert(idx != NULL);
+
+    if (idx->mapped) {
+        munmap(idx->map, idx->map_size);
+    } else {
+        free(idx->map);
+    }
+    *idx = (struct pkt_index){0};
+}
+
+size_t
+pkt_index_seek(struct pkt_index const* idx, uint64_t const offset) {
+    assert(idx != NULL);
+    assert(idx->header != NULL);
+
+    size_t lo = 0;
+    size_t hi = (size_t) idx->header->count;
+    while (lo < hi) {
+        size_t const mid = lo + (hi - lo) / 2;
+        if (idx->records[mid].offset < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * first position in by_entity whose entity is not below the given one
+ */
+static size_t
+entity_bound(struct pkt_index const* idx, int64_t const entity) {
+    size_t lo = 0;
+    size_t hi = (size_t) idx->header->keys;
+    while (lo < hi) {
+        size_t const mid = lo + (hi - lo) / 2;
+        if (idx->by_entity[mid].entity < entity) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+size_t
+pkt_index_entity(struct pkt_index const* idx, entity_id const entity,
+                 size_t* first) {
+    assert(idx != NULL);
+    assert(idx->header != NULL);
+    assert(first != NULL);
+
+    *first = entity_bound(idx, entity);
+    return entity_bound(idx, (int64_t) entity + 1) - *first;
+}
@@ -0,0 +1,100 @@
+/*
+ * index.h: packet index of a capture
+ */
+
+#ifndef OBSIDIAN_INDEX_H
+#define OBSIDIAN_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "dispatch.h"
+
+#define PKT_INDEX_VERSION 3
+
+/*
+ * The index is kept next to a capture, in native byte order. It holds a
+ * record for every packet in capture order, followed by a key for every
+ * entity id of every packet, sorted by entity and then record. Both can be
+ * binary searched.
+ */
+struct pkt_index_header {
+    char magic[4]; /* "OBIX" */
+    uint32_t version;
+    /* a capture that differs in any of these makes the index stale */
+    uint64_t capture_size;
+    uint64_t capture_inode;
+    int64_t capture_mtime_sec;
+    int64_t capture_mtime_nsec;
+
+    uint64_t count; /* packets indexed */
+    uint64_t keys; /* entity keys */
+    uint64_t end; /* offset of the first packet that is not indexed */
+};
+
+struct pkt_index_record {
+    uint64_t offset;
+    uint8_t id;
+    uint8_t reserved[7];
+};
+
+/*
+ * a packet that names two entities has a key under each
+ */
+struct pkt_index_key {
+    uint64_t record;
+    int32_t entity;
+    uint8_t reserved[4];
+};
+
+/*
+ * an index mapped for lookups, or built in memory
+ */
+struct pkt_index {
+    void* map;
+    size_t map_size;
+    bool mapped; /* otherwise map is on the heap */
+    struct pkt_index_header const* header;
+    struct pkt_index_record const* records;
+    struct pkt_index_key const* by_entity;
+};
+
+/*
+ * indexes a capture in memory, the capture is identified by its stat
+ */
+bool
+pkt_index_build(struct pkt_index* idx, struct pkt_table const* t, uint8_t const* data,
+                size_t size, struct stat const* capture);
+
+/*
+ * writes an index to the given path by replacing what is there, a reader
+ * that has the old index mapped keeps it. nothing is left on failure.
+ */
+bool
+pkt_index_write(struct pkt_index const* idx, char const* path);
+
+/*
+ * maps the index at the given path, fails if it does not belong to the
+ * capture with the given stat
+ */
+bool
+pkt_index_open(struct pkt_index* idx, char const* path, struct stat const* capture);
+
+void
+pkt_index_close(struct pkt_index* idx);
+
+/*
+ * number of the first record at or after an offset
+ */
+size_t
+pkt_index_seek(struct pkt_index const* idx, uint64_t offset);
+
+/*
+ * finds where the keys of an entity are in by_entity, returns their count
+ */
+size_t
+pkt_index_entity(struct pkt_index const* idx, entity_id entity, size_t* first);
+
+#endif //OBSIDIAN_INDEX_H
@@ -0,0 +1,332 @@
+/*
+ * moves.c: batch decoding of entity movement
+ *
+ * The packets of a run are found with a scalar scan, then decoded a block at
+ * a time. Every packet is loaded as 16 bytes from the start of its payload,
+ * which covers its entity id and coordinates. A byte shuffle per kind swaps
+ * them into four little-endian lanes, placing relative coordinates in the top
+ * byte of their lane so that an arithmetic shift sign extends them. A 4x4
+ * transpose then turns the per-packet lanes into the field arrays. Packets
+ * too close to the end of the input, and machines without SSE4.1, take the
+ * scalar path. The path is picked once, when the arrays are allocated.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MOVES_SIMD
+#endif
+
+#include "moves.h"
+
+#define KINDS 4
+#define BLOCK 8 /* packets decoded together, the widest vector path */
+#define LOAD_SIZE 16u
+
+#define kind_of(id) ((unsigned) (id) - SRV_ENT_MOVE)
+
+static size_t const payload_size[KINDS] = {
+    SRV_PKT_ENT_MOVE_SIZE,
+    SRV_PKT_ENT_LOOK_SIZE,
+    SRV_PKT_ENT_MOVE_LOOK_SIZE,
+    SRV_PKT_ENT_FULL_POS_SIZE,
+};
+
+/* where the rotation is in a payload, 0 when there is none */
+static size_t const yaw_at[KINDS] = {0, 4, 7, 16};
+
+bool
+pkt_moves_supports(enum pkt_moves_path const path) {
+    switch (path) {
+        case PKT_MOVES_SCALAR:
+            return true;
+
+#ifdef MOVES_SIMD
+        case PKT_MOVES_SSE41:
+            return __builtin_cpu_supports("sse4.1");
+
+        case PKT_MOVES_AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.1");
+#endif
+
+        default:
+            return false;
+    }
+}
+
+static enum pkt_moves_path
+widest_path(void) {
+    if (pkt_moves_supports(PKT_MOVES_AVX2)) {
+        return PKT_MOVES_AVX2;
+    }
+    return pkt_moves_supports(PKT_MOVES_SSE41) ? PKT_MOVES_SSE41 : PKT_MOVES_SCALAR;
+}
+
+struct pkt_moves*
+pkt_moves_init(struct pkt_moves* m, size_t const capacity) {
+    assert(m != NULL);
+    assert(capacity > 0);
+
+    *m = (struct pkt_moves){
+        .kind = malloc(capacity * sizeof *m->kind),
+        .entity = malloc(capacity * sizeof *m->entity),
+        .x = malloc(capacity * sizeof *m->x),
+        .y = malloc(capacity * sizeof *m->y),
+        .z = malloc(capacity * sizeof *m->z),
+        .yaw = malloc(capacity * sizeof *m->yaw),
+        .pitch = malloc(capacity * sizeof *m->pitch),
+        .capacity = capacity,
+        .path = widest_path(),
+    };
+
+    if (m->kind == NULL || m->entity == NULL || m->x == NULL || m->y == NULL
+        || m->z == NULL || m->yaw == NULL || m->pitch == NULL) {
+        pkt_moves_end(m);
+        return NULL;
+    }
+    return m;
+}
+
+void
+pkt_moves_end(struct pkt_moves* m) {
+    assert(m != NULL);
+
+    free(m->kind);
+    free(m->entity);
+    free(m->x);
+    free(m->y);
+    free(m->z);
+    free(m->yaw);
+    free(m->pitch);
+    *m = (struct pkt_moves){0};
+}
+
+bool
+pkt_moves_has(mc_byte const id) {
+    return id >= SRV_ENT_MOVE && id <= SRV_ENT_FULL_POS;
+}
+
+static mc_i32
+load_i32(mc_byte const* p) {
+    uint32_t x;
+    memcpy(&x, p, sizeof x);
+    return (mc_i32) __builtin_bswap32(x);
+}
+
+/*
+ * the rotation of a packet, which no vector path decodes
+ */
+static void
+decode_rotation(struct pkt_moves* m, size_t const i, mc_byte const* p,
+                unsigned const k) {
+    size_t const at = yaw_at[k];
+    m->yaw[i] = at != 0 ? (mc_i8) p[at] : 0;
+    m->pitch[i] = at != 0 ? (mc_i8) p[at + 1] : 0;
+}
+
+static void
+decode_scalar(struct pkt_moves* m, mc_byte const* p, unsigned const k) {
+    assert(m->count < m->capacity);
+
+    size_t const i = m->count++;
+    m->kind[i] = (mc_byte) (SRV_ENT_MOVE + k);
+    m->entity[i] = load_i32(p);
+
+    switch (k + SRV_ENT_MOVE) {
+        case SRV_ENT_MOVE:
+        case SRV_ENT_MOVE_LOOK:
+            m->x[i] = (mc_i8) p[4];
+            m->y[i] = (mc_i8) p[5];
+            m->z[i] = (mc_i8) p[6];
+            break;
+
+        case SRV_ENT_FULL_POS:
+            m->x[i] = load_i32(&p[4]);
+            m->y[i] = load_i32(&p[8]);
+            m->z[i] = load_i32(&p[12]);
+            break;
+
+        default:
+            m->x[i] = 0;
+            m->y[i] = 0;
+            m->z[i] = 0;
+            break;
+    }
+
+    decode_rotation(m, i, p, k);
+}
+
+#ifdef MOVES_SIMD
+
+#define Z 0x80 /* shuffles a zero in */
+
+/* payload bytes of each lane: entity id, then x, y and z */
+static uint8_t const shuffle[KINDS][16] = {
+    {3, 2, 1, 0, Z, Z, Z, 4, Z, Z, Z, 5, Z, Z, Z, 6},
+    {3, 2, 1, 0, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z},
+    {3, 2, 1, 0, Z, Z, Z, 4, Z, Z, Z, 5, Z, Z, Z, 6},
+    {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+};
+
+/* lanes that hold a relative coordinate in their top byte */
+static uint8_t const relative[KINDS][16] = {
+    {0, 0, 0, 0, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff},
+    {0},
+    {0, 0, 0, 0, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff},
+    {0},
+};
+
+#undef Z
+
+__attribute__((target("sse4.1")))
+static __m128i
+decode_lanes_sse(mc_byte const* p, unsigned const k) {
+    __m128i const v = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const*) p),
+                                       _mm_loadu_si128((__m128i const*) shuffle[k]));
+    return _mm_blendv_epi8(v, _mm_srai_epi32(v, 24),
+                           _mm_loadu_si128((__m128i const*) relative[k]));
+}
+
+/*
+ * decodes four packets, the payloads are at data plus the given offsets
+ */
+__attribute__((target("sse4.1")))
+static void
+decode_block_sse(struct pkt_moves* m, mc_byte const* data,
+                 size_t const* at, unsigned const* k) {
+    __m128i const v0 = decode_lanes_sse(&data[at[0]], k[0]);
+    __m128i const v1 = decode_lanes_sse(&data[at[1]], k[1]);
+    __m128i const v2 = decode_lanes_sse(&data[at[2]], k[2]);
+    __m128i const v3 = decode_lanes_sse(&data[at[3]], k[3]);
+
+    /* transpose packets into fields */
+    __m128i const t0 = _mm_unpacklo_epi32(v0, v1);
+    __m128i const t1 = _mm_unpacklo_epi32(v2, v3);
+    __m128i const t2 = _mm_unpackhi_epi32(v0, v1);
+    __m128i const t3 = _mm_unpackhi_epi32(v2, v3);
+
+    size_t const i = m->count;
+    _mm_storeu_si128((__m128i*) &m->entity[i], _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*) &m->x[i], _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*) &m->y[i], _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i*) &m->z[i], _mm_unpackhi_epi64(t2, t3));
+
+    for (size_t j = 0; j < 4; j++) {
+        m->kind[i + j] = (mc_byte) (SRV_ENT_MOVE + k[j]);
+        decode_rotation(m, i + j, &data[at[j]], k[j]);
+    }
+    m->count += 4;
+}
+
+__attribute__((target("avx2")))
+static __m256i
+decode_lanes_avx2(mc_byte const* lo, unsigned const klo,
+                  mc_byte const* hi, unsigned const khi) {
+    __m256i const b = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((__m128i const*) lo)),
+        _mm_loadu_si128((__m128i const*) hi), 1);
+    __m256i const s = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((__m128i const*) shuffle[klo])),
+        _mm_loadu_si128((__m128i const*) shuffle[khi]), 1);
+    __m256i const r = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((__m128i const*) relative[klo])),
+        _mm_loadu_si128((__m128i const*) relative[khi]), 1);
+
+    __m256i const v = _mm256_shuffle_epi8(b, s);
+    return _mm256_blendv_epi8(v, _mm256_srai_epi32(v, 24), r);
+}
+
+/*
+ * decodes eight packets, packet n and n + 4 share a register
+ */
+__attribute__((target("avx2")))
+static void
+decode_block_avx2(struct pkt_moves* m, mc_byte const* data,
+                  size_t const* at, unsigned const* k) {
+    __m256i const v0 = decode_lanes_avx2(&data[at[0]], k[0], &data[at[4]], k[4]);
+    __m256i const v1 = decode_lanes_avx2(&data[at[1]], k[1], &data[at[5]], k[5]);
+    __m256i const v2 = decode_lanes_avx2(&data[at[2]], k[2], &data[at[6]], k[6]);
+    __m256i const v3 = decode_lanes_avx2(&data[at[3]], k[3], &data[at[7]], k[7]);
+
+    /* the unpacks stay within each half, so the halves come out in order */
+    __m256i const t0 = _mm256_unpacklo_epi32(v0, v1);
+    __m256i const t1 = _mm256_unpacklo_epi32(v2, v3);
+    __m256i const t2 = _mm256_unpackhi_epi32(v0, v1);
+    __m256i const t3 = _mm256_unpackhi_epi32(v2, v3);
+
+    size_t const i = m->count;
+    _mm256_storeu_si256((__m256i*) &m->entity[i], _mm256_unpacklo_epi64(t0, t1));
+    _mm256_storeu_si256((__m256i*) &m->x[i], _mm256_unpackhi_epi64(t0, t1));
+    _mm256_storeu_si256((__m256i*) &m->y[i], _mm256_unpacklo_epi64(t2, t3));
+    _mm256_storeu_si256((__m256i*) &m->z[i], _mm256_unpackhi_epi64(t2, t3));
+
+    for (size_t j = 0; j < 8; j++) {
+        m->kind[i + j] = (mc_byte) (SRV_ENT_MOVE + k[j]);
+        decode_rotation(m, i + j, &data[at[j]], k[j]);
+    }
+    m->count += 8;
+}
+
+#endif
+
+size_t
+pkt_moves_decode(struct pkt_moves* m, mc_byte const* data, size_t const len) {
+    assert(m != NULL);
+    assert(data != NULL || len == 0);
+
+#ifdef MOVES_SIMD
+    bool const avx2 = m->path >= PKT_MOVES_AVX2;
+    bool const sse = m->path >= PKT_MOVES_SSE41;
+#endif
+
+    size_t off = 0;
+    bool done = false;
+    while (!done) {
+        /* find the next block of packets */
+        size_t at[BLOCK];
+        unsigned k[BLOCK];
+        size_t n = 0;
+        size_t end = off;
+        while (n < BLOCK && m->count + n < m->capacity && end < len) {
+            mc_byte const id = data[end];
+            if (!pkt_moves_has(id)
+                || payload_size[kind_of(id)] > len - end - sizeof id) {
+                done = true;
+                break;
+            }
+
+            at[n] = end + sizeof id;
+            k[n] = kind_of(id);
+            end += sizeof id + payload_size[k[n]];
+            n++;
+        }
+
+        if (n == 0) {
+            break;
+        }
+
+        /* the vector paths load a whole 16 bytes of every payload */
+        size_t i = 0;
+#ifdef MOVES_SIMD
+        bool const room = at[n - 1] + LOAD_SIZE <= len;
+        if (room && avx2 && n == 8) {
+            decode_block_avx2(m, data, at, k);
+            i = 8;
+        }
+        for (; room && sse && i + 4 <= n; i += 4) {
+            decode_block_sse(m, data, &at[i], &k[i]);
+        }
+#endif
+        for (; i < n; i++) {
+            decode_scalar(m, &data[at[i]], k[i]);
+        }
+
+        off = end;
+        done = done || m->count == m->capacity || off == len;
+    }
+
+    return off;
+}
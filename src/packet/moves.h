@@ -0,0 +1,76 @@
+/*
+ * moves.h: batch decoding of entity movement
+ */
+
+#ifndef OBSIDIAN_MOVES_H
+#define OBSIDIAN_MOVES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "types.h"
+
+/*
+ * ways of decoding a block of packets, each one needs the one before
+ */
+enum pkt_moves_path {
+    PKT_MOVES_SCALAR,
+    PKT_MOVES_SSE41,
+    PKT_MOVES_AVX2,
+};
+
+/*
+ * decoded ENT_MOVE, ENT_LOOK, ENT_MOVE_LOOK and ENT_FULL_POS packets, one
+ * array per field
+ *
+ * The coordinates are relative for the moves, and absolute for ENT_FULL_POS.
+ * Fields that a packet does not have are zero, kind tells which packet an
+ * entry came from.
+ */
+struct pkt_moves {
+    mc_byte* kind;
+    entity_id* entity;
+    mc_i32* x;
+    mc_i32* y;
+    mc_i32* z;
+    mc_i8* yaw;
+    mc_i8* pitch;
+    size_t count;
+    size_t capacity;
+    enum pkt_moves_path path; /* the widest this machine has */
+};
+
+/*
+ * allocates arrays for the given number of packets, and picks the path for
+ * this machine
+ */
+struct pkt_moves*
+pkt_moves_init(struct pkt_moves* m, size_t capacity);
+
+/*
+ * frees the arrays
+ */
+void
+pkt_moves_end(struct pkt_moves* m);
+
+/*
+ * whether this machine can take a path, which can then be set on the moves
+ */
+bool
+pkt_moves_supports(enum pkt_moves_path path);
+
+/*
+ * whether a packet id is one of the movement packets
+ */
+bool
+pkt_moves_has(mc_byte id);
+
+/*
+ * decodes the run of movement packets at the start of the given bytes, which
+ * start at a packet id. stops at any other packet, at a packet that is not
+ * complete, or when the arrays are full. returns the bytes decoded.
+ */
+size_t
+pkt_moves_decode(struct pkt_moves* m, mc_byte const* data, size_t len);
+
+#endif //OBSIDIAN_MOVES_H
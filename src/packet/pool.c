@@ -0,0 +1,262 @@
+/*
+ * pool.c: size-classed buffer pool
+ *
+ * Every size class is a power of two. Freed blocks go to a cache owned by
+ * the freeing thread, so the common alloc and free take no locks. A cache
+ * that grows too large spills half of its blocks to a shared depot, and an
+ * empty cache refills from the depot before carving a new slab. Slabs are
+ * never returned to the system, they are what the pool holds.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+#define CLASS_COUNT 14 /* 128 B up to 1 MiB */
+#define SLAB_SIZE (64u * 1024)
+#define HUGEPAGE_SIZE (2u * 1024 * 1024)
+
+/* bytes a thread caches per class before spilling to the depot */
+#define CACHE_BYTES (256u * 1024)
+#define CACHE_MIN_BLOCKS 4u
+
+struct block {
+    struct block* next;
+};
+
+struct depot {
+    pthread_mutex_t lock;
+    struct block* head;
+    size_t count;
+};
+
+struct cache {
+    struct block* head[CLASS_COUNT];
+    size_t count[CLASS_COUNT];
+};
+
+static struct depot depots[CLASS_COUNT] = {
+    [0 ... CLASS_COUNT - 1] = {.lock = PTHREAD_MUTEX_INITIALIZER},
+};
+
+static __thread struct cache cache;
+
+static bool hugepages;
+static size_t hits;
+static size_t misses;
+static size_t held;
+
+static unsigned
+class_of(size_t const sz) {
+    assert(sz <= PKT_POOL_MAX_CLASS);
+
+    unsigned c = 0;
+    while ((PKT_POOL_MIN_CLASS << c) < sz) {
+        c++;
+    }
+    return c;
+}
+
+static size_t
+class_size(unsigned const c) {
+    return (size_t) PKT_POOL_MIN_CLASS << c;
+}
+
+static size_t
+cache_limit(unsigned const c) {
+    size_t const blocks = CACHE_BYTES / class_size(c);
+    return blocks > CACHE_MIN_BLOCKS ? blocks : CACHE_MIN_BLOCKS;
+}
+
+/*
+ * rounds a mapping up to whole pages, or whole hugepages
+ */
+static size_t
+map_size(size_t const sz) {
+    size_t const page = hugepages ? HUGEPAGE_SIZE : (size_t) sysconf(_SC_PAGESIZE);
+    return (sz + page - 1) / page * page;
+}
+
+static void*
+map(size_t const size) {
+    int const prot = PROT_READ | PROT_WRITE;
+    int const flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    /* reserved hugepages first, then transparent ones */
+    if (hugepages) {
+        void* p = mmap(NULL, size, prot, flags | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            return p;
+        }
+    }
+
+    void* p = mmap(NULL, size, prot, flags, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (hugepages) {
+        madvise(p, size, MADV_HUGEPAGE);
+    }
+    return p;
+}
+
+static void
+count(size_t* counter, size_t const n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+/*
+ * moves up to the given number of blocks from one list to another
+ */
+static size_t
+move_blocks(struct block** from, struct block** to, size_t const n) {
+    size_t moved = 0;
+    while (moved < n && *from != NULL) {
+        struct block* b = *from;
+        *from = b->next;
+        b->next = *to;
+        *to = b;
+        moved++;
+    }
+    return moved;
+}
+
+/*
+ * fills an empty cache from the depot, or from a new slab
+ */
+static bool
+refill(unsigned const c) {
+    struct depot* d = &depots[c];
+
+    pthread_mutex_lock(&d->lock);
+    size_t const moved = move_blocks(&d->head, &cache.head[c], cache_limit(c) / 2);
+    d->count -= moved;
+    pthread_mutex_unlock(&d->lock);
+
+    if (moved > 0) {
+        cache.count[c] += moved;
+        count(&hits, 1);
+        return true;
+    }
+
+    /* carve a slab into blocks, a hugepage when we have those */
+    size_t const size = class_size(c);
+    size_t const slab = map_size(size * 2 > SLAB_SIZE ? size * 2 : SLAB_SIZE);
+    uint8_t* p = map(slab);
+    if (p == NULL) {
+        return false;
+    }
+
+    for (size_t off = 0; off + size <= slab; off += size) {
+        struct block* b = (struct block*) &p[off];
+        b->next = cache.head[c];
+        cache.head[c] = b;
+        cache.count[c]++;
+    }
+
+    count(&misses, 1);
+    count(&held, slab);
+    return true;
+}
+
+void
+pkt_pool_hugepages(bool const enable) {
+    hugepages = enable;
+}
+
+void*
+pkt_pool_alloc(size_t const sz, size_t* usable) {
+    assert(sz > 0);
+
+    /* large allocations bypass the classes */
+    if (sz > PKT_POOL_MAX_CLASS) {
+        size_t const size = map_size(sz);
+        void* p = map(size);
+        if (p == NULL) {
+            return NULL;
+        }
+
+        count(&misses, 1);
+        count(&held, size);
+        if (usable != NULL) {
+            *usable = size;
+        }
+        return p;
+    }
+
+    unsigned const c = class_of(sz);
+    if (cache.head[c] != NULL) {
+        count(&hits, 1);
+    } else if (!refill(c)) {
+        return NULL;
+    }
+
+    struct block* b = cache.head[c];
+    cache.head[c] = b->next;
+    cache.count[c]--;
+
+    if (usable != NULL) {
+        *usable = class_size(c);
+    }
+    return b;
+}
+
+void
+pkt_pool_free(void* p, size_t const sz) {
+    if (p == NULL) {
+        return;
+    }
+
+    if (sz > PKT_POOL_MAX_CLASS) {
+        size_t const size = map_size(sz);
+        munmap(p, size);
+        __atomic_fetch_sub(&held, size, __ATOMIC_RELAXED);
+        return;
+    }
+
+    unsigned const c = class_of(sz);
+    struct block* b = p;
+    b->next = cache.head[c];
+    cache.head[c] = b;
+
+    /* spill half, so the next few frees and allocs stay local */
+    if (++cache.count[c] > cache_limit(c)) {
+        struct depot* d = &depots[c];
+        pthread_mutex_lock(&d->lock);
+        size_t const moved = move_blocks(&cache.head[c], &d->head, cache.count[c] / 2);
+        d->count += moved;
+        pthread_mutex_unlock(&d->lock);
+        cache.count[c] -= moved;
+    }
+}
+
+void
+pkt_pool_thread_end(void) {
+    for (unsigned c = 0; c < CLASS_COUNT; c++) {
+        struct depot* d = &depots[c];
+        pthread_mutex_lock(&d->lock);
+        d->count += move_blocks(&cache.head[c], &d->head, cache.count[c]);
+        pthread_mutex_unlock(&d->lock);
+        cache.count[c] = 0;
+    }
+}
+
+void
+pkt_pool_stats(struct pkt_pool_stats* stats) {
+    assert(stats != NULL);
+
+    *stats = (struct pkt_pool_stats){
+        .hits = __atomic_load_n(&hits, __ATOMIC_RELAXED),
+        .misses = __atomic_load_n(&misses, __ATOMIC_RELAXED),
+        .held = __atomic_load_n(&held, __ATOMIC_RELAXED),
+    };
+}
@@ -0,0 +1,57 @@
+/*
+ * pool.h: size-classed buffer pool
+ */
+
+#ifndef OBSIDIAN_POOL_H
+#define OBSIDIAN_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * smallest and largest size class, larger allocations are mapped directly
+ */
+#define PKT_POOL_MIN_CLASS 128u
+#define PKT_POOL_MAX_CLASS (1024u * 1024)
+
+/*
+ * counters shared by all threads
+ */
+struct pkt_pool_stats {
+    size_t hits; /* served from memory the pool already held */
+    size_t misses; /* needed fresh memory from the system */
+    size_t held; /* bytes currently mapped by the pool */
+};
+
+/*
+ * backs new slabs and large allocations with hugepages where possible, set
+ * this before allocating anything
+ */
+void
+pkt_pool_hugepages(bool enable);
+
+/*
+ * allocates at least the given size, and reports the usable size
+ */
+void*
+pkt_pool_alloc(size_t sz, size_t* usable);
+
+/*
+ * returns memory to the pool, given either its requested or usable size
+ */
+void
+pkt_pool_free(void* p, size_t sz);
+
+/*
+ * hands the memory cached by the calling thread back to the shared pool
+ */
+void
+pkt_pool_thread_end(void);
+
+/*
+ * reads the pool counters
+ */
+void
+pkt_pool_stats(struct pkt_pool_stats* stats);
+
+#endif //OBSIDIAN_POOL_H
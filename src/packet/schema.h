@@ -0,0 +1,290 @@
+/*
+ * schema.h: packet layouts
+ *
+ * Every packet is described once here, and its struct, size, reader, writer,
+ * printer and dispatch entry are all generated from that description. To add
+ * a packet, add it to the packet list and give it a field list.
+ *
+ * A packet is X(PFX, pfx, NAME, name, id, label, print, suffix), where print
+ * is one of
+ *
+ *   bare    no payload, no struct
+ *   fields  prints every field, then the suffix
+ *   skip    prints how many bytes were skipped
+ *
+ * A field list is a macro taking F and V. F(type, name, prefix, style) is a
+ * fixed size field of one of the types below, V(name, length, scale, prefix,
+ * style) is a byte payload whose size is an earlier length field times the
+ * scale. A field prints as its prefix followed by its value in the given
+ * style, see dissect.c.
+ */
+
+#ifndef OBSIDIAN_SCHEMA_H
+#define OBSIDIAN_SCHEMA_H
+
+/*
+ * field types, as their c type and wire size
+ */
+#define PKT_CTYPE_i8 mc_i8
+#define PKT_CTYPE_i16 mc_i16
+#define PKT_CTYPE_i32 mc_i32
+#define PKT_CTYPE_i64 mc_i64
+#define PKT_CTYPE_f32 mc_f32
+#define PKT_CTYPE_f64 mc_f64
+#define PKT_CTYPE_bool mc_bool
+#define PKT_CTYPE_eid entity_id
+#define PKT_CTYPE_f27_5 mc_f27_5
+#define PKT_CTYPE_anim enum animation
+#define PKT_CTYPE_c_coords struct mc_c_coords
+#define PKT_CTYPE_b_coords struct mc_b_coords
+#define PKT_CTYPE_extent struct mc_extent
+
+#define PKT_SIZE_i8 1u
+#define PKT_SIZE_i16 2u
+#define PKT_SIZE_i32 4u
+#define PKT_SIZE_i64 8u
+#define PKT_SIZE_f32 4u
+#define PKT_SIZE_f64 8u
+#define PKT_SIZE_bool 1u
+#define PKT_SIZE_eid 4u
+#define PKT_SIZE_f27_5 4u
+#define PKT_SIZE_anim 1u
+#define PKT_SIZE_c_coords 8u
+#define PKT_SIZE_b_coords 10u
+#define PKT_SIZE_extent 3u
+
+/*
+ * expands its arguments only for entity id fields
+ */
+#define PKT_IF_EID_i8(...)
+#define PKT_IF_EID_i16(...)
+#define PKT_IF_EID_i32(...)
+#define PKT_IF_EID_i64(...)
+#define PKT_IF_EID_f32(...)
+#define PKT_IF_EID_f64(...)
+#define PKT_IF_EID_bool(...)
+#define PKT_IF_EID_eid(...) __VA_ARGS__
+#define PKT_IF_EID_f27_5(...)
+#define PKT_IF_EID_anim(...)
+#define PKT_IF_EID_c_coords(...)
+#define PKT_IF_EID_b_coords(...)
+#define PKT_IF_EID_extent(...)
+
+/*
+ * most entity id fields in any one packet, ENT_PICKUP names two
+ */
+#define PKT_MAX_ENTITIES 2
+
+/*
+ * expands its arguments only for packets with, or without, a payload
+ */
+#define PKT_IF_FIELDS_bare(...)
+#define PKT_IF_FIELDS_fields(...) __VA_ARGS__
+#define PKT_IF_FIELDS_skip(...) __VA_ARGS__
+
+#define PKT_IF_BARE_bare(...) __VA_ARGS__
+#define PKT_IF_BARE_fields(...)
+#define PKT_IF_BARE_skip(...)
+
+/*
+ * the field list of a packet
+ */
+#define PKT_FIELDS(PFX, NAME, F, V) PFX##_PKT_##NAME##_FIELDS(F, V)
+
+/*
+ * fixed size of a payload, variable payloads add to this
+ */
+#define PKT_SIZE_OF_F(type, name, prefix, style) + PKT_SIZE_##type
+#define PKT_SIZE_OF_V(name, length, scale, prefix, style)
+#define PKT_SIZE(PFX, NAME) (0u PKT_FIELDS(PFX, NAME, PKT_SIZE_OF_F, PKT_SIZE_OF_V))
+
+/*
+ * client packets
+ */
+#define CLI_PACKETS(X) \
+    X(CLI, cli, HEARTBEAT, heartbeat, 0x00, "HEARTBEAT", bare, "") \
+    X(CLI, cli, HANDSHAKE, handshake, 0x01, "HANDSHAKE", fields, " }") \
+    X(CLI, cli, GROUNDED, grounded, 0x0a, "GROUNDED", fields, " }") \
+    X(CLI, cli, POSITION, position, 0x0b, "POSITION", fields, " }") \
+    X(CLI, cli, ROTATION, rotation, 0x0c, "ROTATION", fields, " }") \
+    X(CLI, cli, FULL_POSITION, full_position, 0x0d, "FULL_POS", fields, " }") \
+    X(CLI, cli, DISCONNECT, disconnect, 0xff, "DISCONNECT", fields, " }")
+
+#define CLI_PKT_HEARTBEAT_FIELDS(F, V)
+
+#define CLI_PKT_HANDSHAKE_FIELDS(F, V) \
+    F(i32, unknown, "{ unknown: ", D) \
+    F(i16, username_length, "", NONE) \
+    V(username, username_length, 1, ", username: ", STR) \
+    F(i16, password_length, "", NONE) \
+    V(password, password_length, 1, ", password: ", STR)
+
+#define CLI_PKT_GROUNDED_FIELDS(F, V) \
+    F(bool, grounded, "{ grounded: ", BOOL)
+
+#define CLI_PKT_POSITION_FIELDS(F, V) \
+    F(f64, x, "{ x: ", F2) \
+    F(f64, y, ", y: ", F2) \
+    F(f64, head_y, ", head_y: ", F2) \
+    F(f64, z, ", z: ", F2) \
+    F(bool, grounded, ", grounded: ", BOOL)
+
+#define CLI_PKT_ROTATION_FIELDS(F, V) \
+    F(f32, rotation, "{ rotation: ", F2) \
+    F(f32, head_pitch, ", head_pitch: ", F2) \
+    F(bool, grounded, ", grounded: ", BOOL)
+
+#define CLI_PKT_FULL_POSITION_FIELDS(F, V) \
+    F(f64, x, "{ x: ", F2) \
+    F(f64, y, ", y: ", F2) \
+    F(f64, head_y, ", head_y: ", F2) \
+    F(f64, z, ", z: ", F2) \
+    F(f32, rotation, ", rotation: ", F2) \
+    F(f32, head_pitch, ", head_pitch: ", F2) \
+    F(bool, grounded, ", grounded: ", BOOL)
+
+#define CLI_PKT_DISCONNECT_FIELDS(F, V) \
+    F(i16, length, "", NONE) \
+    V(reason, length, 1, "{ reason: ", STR)
+
+/*
+ * server packets
+ */
+#define SRV_PACKETS(X) \
+    X(SRV, srv, HEARTBEAT, heartbeat, 0x00, "HEARTBEAT", bare, "") \
+    X(SRV, srv, AUTH, auth, 0x01, "AUTH", fields, " }") \
+    X(SRV, srv, MESSAGE, message, 0x03, "MESSAGE", fields, "") \
+    X(SRV, srv, FULL_POSITION, full_position, 0x0d, "FULL_POS", fields, " }") \
+    X(SRV, srv, ENT_HOLD_ITEM, ent_hold_item, 0x10, "ENT_HOLD_ITEM", fields, " }") \
+    X(SRV, srv, RECEIVE_ITEM, receive_item, 0x11, "RECEIVE_ITEM", fields, " }") \
+    X(SRV, srv, ENT_ANIMATION, ent_animation, 0x12, "ENT_ANIMATION", fields, " }") \
+    X(SRV, srv, SPAWN_PLAYER, spawn_player, 0x14, "SPAWN_PLAYER", fields, " }") \
+    X(SRV, srv, SPAWN_ITEM, spawn_item, 0x15, "SPAWN_ITEM", fields, " }") \
+    X(SRV, srv, ENT_PICKUP, ent_pickup, 0x16, "ENT_PICKUP", fields, " }") \
+    X(SRV, srv, ENT_DESTROY, ent_destroy, 0x1d, "ENT_DESTROY", fields, " }") \
+    X(SRV, srv, ENT_ALIVE, ent_alive, 0x1e, "ENT_ALIVE", fields, " }") \
+    X(SRV, srv, ENT_MOVE, ent_move, 0x1f, "ENT_MOVE", fields, " }") \
+    X(SRV, srv, ENT_LOOK, ent_look, 0x20, "ENT_LOOK", fields, " }") \
+    X(SRV, srv, ENT_MOVE_LOOK, ent_move_look, 0x21, "ENT_MOVE_LOOK", fields, " }") \
+    X(SRV, srv, ENT_FULL_POS, ent_full_pos, 0x22, "ENT_FULL_POS", fields, " }") \
+    X(SRV, srv, CHUNK, chunk, 0x32, "CHUNK", fields, " }") \
+    X(SRV, srv, CHUNK_DATA, chunk_data, 0x33, "CHUNK_DATA", fields, " }") \
+    X(SRV, srv, 0x34, 0x34, 0x34, "UNKNOWN", skip, "") \
+    X(SRV, srv, 0x35, 0x35, 0x35, "UNKNOWN", skip, "")
+
+#define SRV_PKT_HEARTBEAT_FIELDS(F, V)
+
+#define SRV_PKT_AUTH_FIELDS(F, V) \
+    F(i32, unknown0, "{ unknown0: ", D) \
+    F(i32, unknown1, ", unknown1: ", D)
+
+#define SRV_PKT_MESSAGE_FIELDS(F, V) \
+    F(i16, length, "", NONE) \
+    V(bytes, length, 1, "", STR)
+
+/* the y-positions are swapped compared to the client packet */
+#define SRV_PKT_FULL_POSITION_FIELDS(F, V) \
+    F(f64, x, "{ x: ", F2) \
+    F(f64, head_y, ", head_y: ", F2) \
+    F(f64, y, ", y: ", F2) \
+    F(f64, z, ",  z: ", F2) \
+    F(f32, rotation, ", rotation: ", F2) \
+    F(f32, head_pitch, ", head_pitch: ", F2) \
+    F(bool, grounded, ", grounded: ", BOOL)
+
+#define SRV_PKT_ENT_HOLD_ITEM_FIELDS(F, V) \
+    F(eid, entity, "{ entity: ", X8) \
+    F(i16, item, ", item: ", D)
+
+#define SRV_PKT_RECEIVE_ITEM_FIELDS(F, V) \
+    F(i16, item, "{ item: ", D) \
+    F(i8, count, ", count: ", D) \
+    F(i16, durability, ", durability: ", D)
+
+#define SRV_PKT_ENT_ANIMATION_FIELDS(F, V) \
+    F(eid, entity, "{ entity: ", X8) \
+    F(anim, animation, ", animation: ", ANIM)
+
+#define SRV_PKT_SPAWN_PLAYER_FIELDS(F, V) \
+    F(eid, entity, "{ entity: ", X8) \
+    F(i16, name_length, "", NONE) \
+    V(name, name_length, 1, ", name: ", STR) \
+    F(f27_5, x, ", x: ", POS) \
+    F(f27_5, y, ", y: ", POS) \
+    F(f27_5, z, ", z: ", POS) \
+    F(i8, yaw, ", yaw: ", ANG128) \
+    F(i8, pitch, ", pitch ", ANG128_WHOLE) \
+    F(i16, item, ", item: ", D)
+
+#define SRV_PKT_SPAWN_ITEM_FIELDS(F, V) \
+    F(eid, entity, "{ entity: ", X8) \
+    F(i16, item, ", item: ", X4) \
+    F(i8, count, ", count: ", D) \
+    F(f27_5, x, ", x: ", POS) \
+    F(f27_5, y, ", y: ", POS) \
+    F(f27_5, z, ", z: ", POS) \
+    F(i8, yaw, ", yaw: ", ANG128) \
+    F(i8, pitch, ", pitch: ", ANG128) \
+    F(i8, unknown, ", unknown: ", D)
+
+#define SRV_PKT_ENT_PICKUP_FIELDS(F, V) \
+    F(eid, item, "{ entity: ", X8) \
+    F(eid, entity, ", receiver: ", X8)
+
+#define SRV_PKT_ENT_DESTROY_FIELDS(F, V) \
+    F(eid, entity, "{ entity: ", X8)
+
+#define SRV_PKT_ENT_ALIVE_FIELDS(F, V) \
+    F(eid, entity, "{ entity: ", X8)
+
+#define SRV_PKT_ENT_MOVE_FIELDS(F, V) \
+    F(eid, id, "{ entity: ", X8) \
+    F(i8, x, ", x: ", POS) \
+    F(i8, y, ", y: ", POS) \
+    F(i8, z, ", z: ", POS)
+
+#define SRV_PKT_ENT_LOOK_FIELDS(F, V) \
+    F(eid, id, "{ entity: ", X8) \
+    F(i8, yaw, ", yaw: ", ANG256) \
+    F(i8, pitch, ", pitch: ", ANG256)
+
+#define SRV_PKT_ENT_MOVE_LOOK_FIELDS(F, V) \
+    F(eid, id, "{ entity: ", X8) \
+    F(i8, x, ", x: ", POS) \
+    F(i8, y, ", y: ", POS) \
+    F(i8, z, ", z: ", POS) \
+    F(i8, yaw, ", yaw: ", ANG256) \
+    F(i8, pitch, ", pitch: ", ANG256)
+
+#define SRV_PKT_ENT_FULL_POS_FIELDS(F, V) \
+    F(eid, id, "{ entity: ", X8) \
+    F(f27_5, x, ", x: ", POS) \
+    F(f27_5, y, ", y: ", POS) \
+    F(f27_5, z, ", z: ", POS) \
+    F(i8, yaw, ", yaw: ", ANG256) \
+    F(i8, pitch, ", pitch: ", ANG256)
+
+#define SRV_PKT_CHUNK_FIELDS(F, V) \
+    F(c_coords, chunk, "{ ", XZ) \
+    F(bool, load, ", load: ", BOOL)
+
+#define SRV_PKT_CHUNK_DATA_FIELDS(F, V) \
+    F(b_coords, origin, "{ origin( ", XYZ) \
+    F(extent, extent, " ), extent( ", XYZ) \
+    F(i32, compressed_size, " ) size ", D) \
+    V(data, compressed_size, 1, ", data: ...", NONE)
+
+/* layout guessed from captures, the meaning is still unknown */
+#define SRV_PKT_0x34_FIELDS(F, V) \
+    F(i32, unknown0, "", NONE) \
+    F(i32, unknown1, "", NONE) \
+    F(i16, count, "", NONE) \
+    V(data, count, 4, "", NONE)
+
+#define SRV_PKT_0x35_FIELDS(F, V) \
+    F(i8, unknown0, "", NONE) \
+    F(i32, unknown1, "", NONE) \
+    F(i32, unknown2, "", NONE) \
+    F(i16, unknown3, "", NONE)
+
+#endif //OBSIDIAN_SCHEMA_H
@@ -10,4 +10,22 @@ animation_name(enum animation anim) {
         case ANIMATION_ARM_SWING: return "arm_swing";
         default: return "unknown";
     }
-}
\ No newline at end of file
+}
+#define PKT_NAME_CASE(PFX, pfx, NAME, name, id, label, print, suffix) \
+    case PFX##_##NAME: return label;
+
+char const*
+cli_pkt_name(enum cli_pkt const pkt) {
+    switch (pkt) {
+        CLI_PACKETS(PKT_NAME_CASE)
+        default: return "UNKNOWN";
+    }
+}
+
+char const*
+srv_pkt_name(enum srv_pkt const pkt) {
+    switch (pkt) {
+        SRV_PACKETS(PKT_NAME_CASE)
+        default: return "UNKNOWN";
+    }
+}
@@ -3,249 +3,1039 @@
  *
  * This file implements a simple passthrough proxy, I use it to poke at the
  * protocol and to verify the veracity of my encoder and decoder.
+ *
+ * Connections are served by one or more workers. Every worker owns a
+ * listening socket bound with SO_REUSEPORT, its own io_uring and its own
+ * sessions, so workers share no state and need no locks. The listening socket
+ * is driven by a multishot accept, and every accepted client gets a session
+ * holding the relay in each direction, so sessions progress independently of
+ * each other.
+ *
+ * A session relays either by copying through provided buffers, which lets us
+ * look at the bytes, or in passthrough mode by splicing from socket to pipe to
+ * socket, where the bytes never enter user space.
  */
 
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <getopt.h>
 #include <liburing.h>
 #include <netdb.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "packet/buffer.h"
+#include "packet/framer.h"
+#include "packet/pool.h"
+
+#define RING_ENTRIES 256
+
+/* buffers provided to the kernel for receives, per worker */
+#define CLIENT_BUFFER_GROUP 0
+#define CLIENT_BUFFER_COUNT 256
+#define CLIENT_BUFFER_SIZE 512
+#define SERVER_BUFFER_GROUP 1
+#define SERVER_BUFFER_COUNT 256
+#define SERVER_BUFFER_SIZE (1024 * 16)
+
+/* provided buffers a relay may hold before it stops receiving */
+#define RELAY_QUEUE 8
+
+/*
+ * operations are told apart by tagging the low bits of the relay pointer in
+ * the user data, as a relay can have a receive and a send in flight at once
+ */
+enum op {
+    OP_ACCEPT,
+    OP_CONNECT,
+    OP_RECEIVE,
+    OP_SEND,
+    OP_SPLICE_IN,
+    OP_SPLICE_OUT,
+};
+
+#define OP_MASK 0x7u
 
-enum phase {
-    PHASE_RECEIVE,
-    PHASE_SEND,
+enum relay_mode {
+    MODE_COPY,   /* through user space buffers */
+    MODE_SPLICE, /* socket to pipe to socket, no decoding possible */
 };
 
+struct session;
+
+/*
+ * a provided buffer queued for sending, the read cursor marks how much of it
+ * has been sent already
+ */
+struct chunk {
+    unsigned short id;
+    struct pkt_buffer buffer;
+    size_t framed; /* bytes up to the last packet boundary in the buffer */
+};
+
+/*
+ * one direction of a session
+ *
+ * The queue is a ring of received buffers, receives fill it at the tail while
+ * sends drain it from the head, so both can be in flight at the same time. A
+ * relay only stops receiving once the queue is full. Received bytes are framed
+ * into packets in place, and only whole packets are sent on.
+ *
+ * Passthrough relays do the same with two pipes. A splice holds the pipe lock
+ * while it blocks, so splicing in and out of one pipe at once could deadlock;
+ * instead each splice in fills an empty pipe while the other one drains.
+ */
 struct relay {
     int from;
     int to;
-    enum phase phase;
-    struct pkt_buffer buffer;
+    struct buf_pool* pool;
+    struct chunk queue[RELAY_QUEUE];
+    unsigned head; /* next chunk to send */
+    unsigned tail; /* next chunk to receive into */
+    struct pkt_framer framer;
+    struct iovec iov[RELAY_QUEUE];
+    struct msghdr msg;
+    bool receiving;
+    bool sending;
+    bool starved; /* waiting for the pool to have a free buffer */
+    bool eof; /* the peer is done sending */
+    int pipes[2][2]; /* passthrough mode only */
+    size_t piped[2]; /* bytes spliced into each pipe but not out yet */
+    unsigned fill; /* pipe the next splice in goes to */
+    unsigned drain; /* pipe the next splice out comes from */
+    size_t pipe_size;
+    size_t total; /* bytes relayed */
+    struct session* session;
+    struct relay* next_starved;
 };
 
+/*
+ * a client connection and our connection to the server on its behalf
+ */
+struct session {
+    struct relay client;
+    struct relay server;
+    enum relay_mode mode;
+    struct timespec opened;
+    unsigned pending; /* operations in flight */
+    bool closing;
+};
+
+/*
+ * buffers registered with the ring as a provided buffer ring, a receive only
+ * takes one of these once data has actually arrived
+ */
+struct buf_pool {
+    struct io_uring_buf_ring* ring;
+    uint8_t* data;
+    size_t size; /* bytes per buffer */
+    unsigned count;
+    unsigned short group;
+    struct relay* starved; /* relays waiting for a free buffer */
+};
+
+/*
+ * a thread with its own listener, ring and sessions
+ */
+struct worker {
+    pthread_t thread;
+    unsigned index;
+    int cpu; /* cpu to pin to, or -1 */
+    struct io_uring io;
+    int listen_fd;
+    struct addrinfo const* server_info;
+    enum relay_mode mode; /* mode of new sessions */
+    size_t sessions;
+    struct buf_pool client_bufs;
+    struct buf_pool server_bufs;
+};
+
+static int
+buf_pool_init(struct io_uring* io, struct buf_pool* pool,
+              unsigned short group, unsigned count, size_t size) {
+    assert((count & (count - 1)) == 0);
+
+    /* the ring itself has to be page aligned */
+    void* ring;
+    size_t const ring_size = count * sizeof(struct io_uring_buf);
+    int const err = posix_memalign(&ring, (size_t) sysconf(_SC_PAGESIZE), ring_size);
+    if (err != 0) {
+        return -err;
+    }
+
+    uint8_t* data = pkt_pool_alloc(count * size, NULL);
+    if (data == NULL) {
+        free(ring);
+        return -ENOMEM;
+    }
+
+    *pool = (struct buf_pool){
+        .ring = ring,
+        .data = data,
+        .size = size,
+        .count = count,
+        .group = group,
+    };
+    io_uring_buf_ring_init(pool->ring);
+
+    struct io_uring_buf_reg reg = {
+        .ring_addr = (unsigned long) ring,
+        .ring_entries = count,
+        .bgid = group,
+    };
+    int const ret = io_uring_register_buf_ring(io, &reg, 0);
+    if (ret != 0) {
+        pkt_pool_free(data, count * size);
+        free(ring);
+        return ret;
+    }
+
+    /* hand every buffer to the kernel */
+    int const mask = io_uring_buf_ring_mask(count);
+    for (unsigned i = 0; i < count; i++) {
+        io_uring_buf_ring_add(pool->ring, &data[i * size], size, i, mask, i);
+    }
+    io_uring_buf_ring_advance(pool->ring, count);
+    return 0;
+}
+
 static void
-handle_receive(struct io_uring* io, struct relay* relay,
+buf_pool_end(struct io_uring* io, struct buf_pool* pool) {
+    io_uring_unregister_buf_ring(io, pool->group);
+    pkt_pool_free(pool->data, pool->count * pool->size);
+    free(pool->ring);
+}
+
+static void
+buf_pool_forget(struct buf_pool* pool, struct relay* relay) {
+    for (struct relay** it = &pool->starved; *it != NULL; it = &(*it)->next_starved) {
+        if (*it == relay) {
+            *it = relay->next_starved;
+            relay->next_starved = NULL;
+            relay->starved = false;
+            return;
+        }
+    }
+}
+
+static struct io_uring_sqe*
+get_sqe(struct io_uring* io) {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(io);
+    if (sqe == NULL) {
+        /* the submission queue is full, flush it and try again */
+        io_uring_submit(io);
+        sqe = io_uring_get_sqe(io);
+    }
+
+    assert(sqe != NULL);
+    return sqe;
+}
+
+static void
+set_op(struct io_uring_sqe* sqe, struct relay* relay, enum op const op) {
+    uintptr_t const ptr = (uintptr_t) relay;
+    assert((ptr & OP_MASK) == 0);
+    io_uring_sqe_set_data64(sqe, (uint64_t) (ptr | op));
+    if (relay != NULL) {
+        relay->session->pending++;
+    }
+}
+
+static unsigned
+queued(struct relay const* relay) {
+    return relay->tail - relay->head;
+}
+
+static void
+queue_accept(struct worker* w) {
+    struct io_uring_sqe* sqe = get_sqe(&w->io);
+    io_uring_prep_multishot_accept(sqe, w->listen_fd, NULL, NULL, 0);
+    set_op(sqe, NULL, OP_ACCEPT);
+}
+
+static void
+queue_connect(struct io_uring* io, struct relay* relay,
+              struct addrinfo const* info) {
+    struct io_uring_sqe* sqe = get_sqe(io);
+    io_uring_prep_connect(sqe, relay->from, info->ai_addr, info->ai_addrlen);
+    set_op(sqe, relay, OP_CONNECT);
+}
+
+static void
+queue_receive(struct io_uring* io, struct relay* relay) {
+    assert(!relay->receiving);
+    assert(queued(relay) < RELAY_QUEUE);
+
+    /* the kernel picks a buffer from the pool once data arrives */
+    struct io_uring_sqe* sqe = get_sqe(io);
+    relay->receiving = true;
+    io_uring_prep_recv(sqe, relay->from, NULL, relay->pool->size, 0);
+    io_uring_sqe_set_flags(sqe, IOSQE_BUFFER_SELECT);
+    sqe->buf_group = relay->pool->group;
+    set_op(sqe, relay, OP_RECEIVE);
+}
+
+/*
+ * gathers the queued bytes that can be sent into the iovecs of the relay,
+ * returns how many iovecs were used
+ */
+static size_t
+gather(struct relay* relay) {
+    /* only whole packets, unless the queue is stuck or the peer is gone */
+    bool const flush = queued(relay) == RELAY_QUEUE || relay->eof;
+    unsigned end = relay->head;
+    for (unsigned i = relay->head; i != relay->tail; i++) {
+        struct chunk const* chunk = &relay->queue[i % RELAY_QUEUE];
+        if (flush || chunk->framed > chunk->buffer.pos) {
+            end = i + 1;
+        }
+    }
+
+    /* a later boundary means earlier chunks only hold whole packets */
+    size_t count = 0;
+    for (unsigned i = relay->head; i != end; i++) {
+        struct chunk const* chunk = &relay->queue[i % RELAY_QUEUE];
+        struct pkt_buffer const* b = &chunk->buffer;
+        size_t const stop = i + 1 == end && !flush ? chunk->framed : b->cur;
+        relay->iov[count++] = (struct iovec){
+            .iov_base = &b->data[b->pos],
+            .iov_len = stop - b->pos,
+        };
+    }
+
+    return count;
+}
+
+static void
+queue_send(struct io_uring* io, struct relay* relay, size_t const count) {
+    assert(!relay->sending);
+    assert(count > 0);
+
+    /* send everything gathered at once */
+    relay->msg = (struct msghdr){
+        .msg_iov = relay->iov,
+        .msg_iovlen = count,
+    };
+
+    struct io_uring_sqe* sqe = get_sqe(io);
+    relay->sending = true;
+    io_uring_prep_sendmsg(sqe, relay->to, &relay->msg, MSG_NOSIGNAL);
+    set_op(sqe, relay, OP_SEND);
+}
+
+static void
+queue_splice_in(struct io_uring* io, struct relay* relay) {
+    assert(!relay->receiving);
+    assert(relay->piped[relay->fill] == 0);
+
+    /* never ask for more than the pipe can take without blocking */
+    struct io_uring_sqe* sqe = get_sqe(io);
+    relay->receiving = true;
+    io_uring_prep_splice(sqe, relay->from, -1, relay->pipes[relay->fill][1], -1,
+                         (unsigned) relay->pipe_size, SPLICE_F_MOVE);
+    set_op(sqe, relay, OP_SPLICE_IN);
+}
+
+static void
+queue_splice_out(struct io_uring* io, struct relay* relay) {
+    assert(!relay->sending);
+    assert(relay->piped[relay->drain] > 0);
+
+    struct io_uring_sqe* sqe = get_sqe(io);
+    relay->sending = true;
+    io_uring_prep_splice(sqe, relay->pipes[relay->drain][0], -1, relay->to, -1,
+                         (unsigned) relay->piped[relay->drain], SPLICE_F_MOVE);
+    set_op(sqe, relay, OP_SPLICE_OUT);
+}
+
+static void
+session_close(struct session* s);
+
+/*
+ * starts whatever receive and send a relay is able to do right now
+ */
+static void
+relay_pump(struct io_uring* io, struct relay* relay) {
+    if (relay->session->closing) {
+        return;
+    }
+
+    if (relay->session->mode == MODE_SPLICE) {
+        if (!relay->receiving && !relay->eof && relay->piped[relay->fill] == 0) {
+            queue_splice_in(io, relay);
+        }
+
+        if (!relay->sending && relay->piped[relay->drain] > 0) {
+            queue_splice_out(io, relay);
+        }
+    } else {
+        if (!relay->receiving && !relay->eof && !relay->starved
+            && queued(relay) < RELAY_QUEUE) {
+            queue_receive(io, relay);
+        }
+
+        size_t const count = relay->sending ? 0 : gather(relay);
+        if (count > 0) {
+            queue_send(io, relay, count);
+        }
+    }
+
+    /* the peer hung up and everything it sent has been passed on */
+    if (relay->eof && !relay->sending && relay->piped[relay->drain] == 0
+        && queued(relay) == 0) {
+        session_close(relay->session);
+    }
+}
+
+/*
+ * returns a buffer to its pool, and lets a relay that was waiting for one
+ * receive again
+ */
+static void
+release_buffer(struct io_uring* io, struct buf_pool* pool,
+               struct chunk const* chunk) {
+    io_uring_buf_ring_add(pool->ring, chunk->buffer.data, pool->size,
+                          chunk->id, io_uring_buf_ring_mask(pool->count), 0);
+    io_uring_buf_ring_advance(pool->ring, 1);
+
+    struct relay* starved = pool->starved;
+    if (starved != NULL) {
+        pool->starved = starved->next_starved;
+        starved->next_starved = NULL;
+        starved->starved = false;
+        relay_pump(io, starved);
+    }
+}
+
+static void
+relay_close_pipes(struct relay* relay) {
+    for (size_t i = 0; i < 2; i++) {
+        if (relay->pipes[i][0] != -1) {
+            close(relay->pipes[i][0]);
+            close(relay->pipes[i][1]);
+        }
+    }
+}
+
+static int
+relay_open_pipes(struct relay* relay) {
+    for (size_t i = 0; i < 2; i++) {
+        if (pipe2(relay->pipes[i], O_CLOEXEC) == -1) {
+            relay_close_pipes(relay);
+            return -1;
+        }
+    }
+
+    relay->pipe_size = (size_t) fcntl(relay->pipes[0][1], F_GETPIPE_SZ);
+    return 0;
+}
+
+static struct session*
+session_open(struct worker* w, int client_fd, int server_fd) {
+    /* sessions come and go with every connection, keep them pooled */
+    struct session* s = pkt_pool_alloc(sizeof *s, NULL);
+    if (s == NULL) {
+        return NULL;
+    }
+    memset(s, 0, sizeof *s);
+
+    s->mode = w->mode;
+    clock_gettime(CLOCK_MONOTONIC, &s->opened);
+
+    s->client = (struct relay){
+        .from = client_fd,
+        .to = server_fd,
+        .pool = &w->client_bufs,
+        .pipes = {{-1, -1}, {-1, -1}},
+        .session = s,
+    };
+
+    s->server = (struct relay){
+        .from = server_fd,
+        .to = client_fd,
+        .pool = &w->server_bufs,
+        .pipes = {{-1, -1}, {-1, -1}},
+        .session = s,
+    };
+
+    pkt_framer_init(&s->client.framer, &pkt_cli_table);
+    pkt_framer_init(&s->server.framer, &pkt_srv_table);
+
+    /* passthrough relays keep their bytes in pipes instead */
+    if (s->mode == MODE_SPLICE) {
+        if (relay_open_pipes(&s->client) == -1) {
+            pkt_pool_free(s, sizeof *s);
+            return NULL;
+        }
+
+        if (relay_open_pipes(&s->server) == -1) {
+            relay_close_pipes(&s->client);
+            pkt_pool_free(s, sizeof *s);
+            return NULL;
+        }
+    }
+
+    return s;
+}
+
+/*
+ * stops both directions of a session, it is released once all operations
+ * still in flight have completed
+ */
+static void
+session_close(struct session* s) {
+    if (s->closing) {
+        return;
+    }
+
+    /* wakes up any receive or send still waiting on these sockets */
+    s->closing = true;
+    shutdown(s->client.from, SHUT_RDWR);
+    shutdown(s->server.from, SHUT_RDWR);
+}
+
+static void
+relay_end(struct io_uring* io, struct relay* relay) {
+    /* a relay waiting for a buffer has nothing in flight */
+    buf_pool_forget(relay->pool, relay);
+    for (; relay->head != relay->tail; relay->head++) {
+        release_buffer(io, relay->pool, &relay->queue[relay->head % RELAY_QUEUE]);
+    }
+
+    pkt_framer_end(&relay->framer);
+    relay_close_pipes(relay);
+    close(relay->from);
+}
+
+static void
+session_end(struct worker* w, struct session* s) {
+    assert(s->closing);
+    assert(s->pending == 0);
+
+    relay_end(&w->io, &s->server);
+    relay_end(&w->io, &s->client);
+
+    /* report throughput, so both relay modes can be compared */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double const seconds = (double) (now.tv_sec - s->opened.tv_sec)
+                           + (double) (now.tv_nsec - s->opened.tv_nsec) / 1e9;
+    size_t const bytes = s->client.total + s->server.total;
+    w->sessions--;
+    printf("Connections closed (%s): %zu bytes (%zu packets) up, "
+           "%zu bytes (%zu packets) down "
+           "in %.3fs, %.1f MiB/s, %zu sessions remaining\n",
+           s->mode == MODE_SPLICE ? "splice" : "copy",
+           s->client.total, s->client.framer.packets, s->server.total,
+           s->server.framer.packets, seconds,
+           seconds > 0 ? (double) bytes / seconds / (1024 * 1024) : 0.0,
+           w->sessions);
+    pkt_pool_free(s, sizeof *s);
+
+    /* show how well the pool keeps allocations off the accept path */
+    if (w->sessions == 0) {
+        struct pkt_pool_stats stats;
+        pkt_pool_stats(&stats);
+        printf("Buffer pool: %zu hits, %zu misses, %zu KiB held\n",
+               stats.hits, stats.misses, stats.held / 1024);
+    }
+}
+
+static void
+handle_accept(struct worker* w, struct io_uring_cqe* cqe) {
+    /* the kernel stops a multishot accept on errors, so re-arm it */
+    if ((cqe->flags & IORING_CQE_F_MORE) == 0) {
+        queue_accept(w);
+    }
+
+    if (cqe->res < 0) {
+        fprintf(stderr, "error: accept failed: %s\n", strerror(-cqe->res));
+        return;
+    }
+
+    int const client_fd = cqe->res;
+    printf("Accepted client connection\n");
+
+    /* connect to the server on the client's behalf */
+    struct addrinfo const* info = w->server_info;
+    int const server_fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    if (server_fd == -1) {
+        perror("socket");
+        close(client_fd);
+        return;
+    }
+
+    struct session* s = session_open(w, client_fd, server_fd);
+    if (s == NULL) {
+        fprintf(stderr, "error: could not allocate session\n");
+        close(server_fd);
+        close(client_fd);
+        return;
+    }
+
+    w->sessions++;
+    queue_connect(&w->io, &s->server, info);
+}
+
+static void
+handle_connect(struct io_uring* io, struct relay* relay,
                struct io_uring_cqe* cqe) {
+    struct session* s = relay->session;
     if (cqe->res < 0) {
-        fprintf(stderr, "error: receive failed: %s\n", strerror(-cqe->res));
-        exit(EXIT_FAILURE);
+        fprintf(stderr, "error: connect failed: %s\n", strerror(-cqe->res));
+        session_close(s);
+        return;
     }
 
-    /* check how many bytes we got */
-    size_t bytes_in = (size_t) cqe->res;
+    printf("Connected to server\n");
 
-    /* update buffer state */
-    relay->buffer.cur += bytes_in;
+    /* stage the initial receives from the client and the server */
+    relay_pump(io, &s->client);
+    relay_pump(io, &s->server);
+}
 
-    /* todo: decode packets here if we can */
+/*
+ * finds the packet boundaries in a received chunk
+ */
+static void
+relay_frame(struct relay* relay, struct chunk* chunk) {
+    struct pkt_framer* framer = &relay->framer;
+    bool const lost = framer->lost;
+    struct pkt_buffer const* b = &chunk->buffer;
+    chunk->framed = pkt_framer_feed(framer, b->data, b->cur);
 
+    if (framer->lost && !lost) {
+        fprintf(stderr, "error: unknown packet 0x%02x, relaying without framing\n",
+                framer->unknown);
+    }
+}
 
-    /* send this data to the next */
-    struct io_uring_sqe* sqe = io_uring_get_sqe(io);
-    relay->phase = PHASE_SEND;
-    io_uring_prep_send(
-        sqe,
-        relay->to,
-        &relay->buffer.data[relay->buffer.pos],
-        relay->buffer.cur - relay->buffer.pos,
-        0
-    );
-    io_uring_sqe_set_data(sqe, relay);
+static void
+handle_receive(struct io_uring* io, struct relay* relay,
+               struct io_uring_cqe* cqe) {
+    relay->receiving = false;
+
+    /* the kernel only consumes a buffer when data arrived */
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned short const id = (unsigned short) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        struct chunk* chunk = &relay->queue[relay->tail % RELAY_QUEUE];
+        *chunk = (struct chunk){
+            .id = id,
+            .buffer.data = &relay->pool->data[id * relay->pool->size],
+            .buffer.capacity = relay->pool->size,
+        };
+
+        if (cqe->res > 0) {
+            chunk->buffer.cur = (size_t) cqe->res;
+            chunk->buffer.in_total = (size_t) cqe->res;
+            relay->tail++;
+            relay_frame(relay, chunk);
+        } else {
+            release_buffer(io, relay->pool, chunk);
+        }
+    }
+
+    if (cqe->res == -ENOBUFS) {
+        /* every buffer is in use, wait until one is released */
+        if (!relay->session->closing) {
+            relay->starved = true;
+            relay->next_starved = relay->pool->starved;
+            relay->pool->starved = relay;
+        }
+        return;
+    }
+
+    if (cqe->res < 0) {
+        fprintf(stderr, "error: receive failed: %s\n", strerror(-cqe->res));
+        session_close(relay->session);
+        return;
+    }
+
+    /* an empty receive means the peer hung up, finish sending first */
+    if (cqe->res == 0) {
+        relay->eof = true;
+    }
 
-    /* done with this CQE */
-    io_uring_cqe_seen(io, cqe);
+    /* send whole packets to the next, and keep receiving */
+    relay_pump(io, relay);
 }
 
 static void
 handle_send(struct io_uring* io, struct relay* relay,
             struct io_uring_cqe* cqe) {
+    relay->sending = false;
     if (cqe->res < 0) {
         fprintf(stderr, "error: send failed: %s\n", strerror(-cqe->res));
-        exit(EXIT_FAILURE);
+        session_close(relay->session);
+        return;
     }
 
-    /* check how many bytes we got */
-    size_t const bytes_out = (size_t) cqe->res;
+    /* consume what was sent from the head of the queue */
+    size_t bytes_out = (size_t) cqe->res;
+    relay->total += bytes_out;
+    while (bytes_out > 0) {
+        struct chunk* chunk = &relay->queue[relay->head % RELAY_QUEUE];
+        size_t const avail = chunk->buffer.cur - chunk->buffer.pos;
+        size_t const used = bytes_out < avail ? bytes_out : avail;
+        chunk->buffer.pos += used;
+        chunk->buffer.out_total += used;
+        bytes_out -= used;
 
-    /* update buffer state */
-    relay->buffer.pos += bytes_out;
-    relay->buffer.out_total += bytes_out;
-    pkt_buffer_drop(&relay->buffer);
+        /* fully sent buffers go straight back to the pool */
+        if (chunk->buffer.pos == chunk->buffer.cur) {
+            relay->head++;
+            release_buffer(io, relay->pool, chunk);
+        }
+    }
 
-    struct io_uring_sqe* sqe = io_uring_get_sqe(io);
-    if (relay->buffer.pos == relay->buffer.cur) {
-        /* we're sent all bytes, so get ready to receive */
-        relay->phase = PHASE_RECEIVE;
-        io_uring_prep_recv(
-            sqe,
-            relay->from,
-            &relay->buffer.data[relay->buffer.cur],
-            relay->buffer.capacity - relay->buffer.cur,
-            0
-        );
-    } else {
-        /* didn't send all bytes yet, so continue sending */
-        io_uring_prep_send(
-            sqe,
-            relay->to,
-            &relay->buffer.data[relay->buffer.pos],
-            relay->buffer.cur - relay->buffer.pos,
-            0
-        );
+    relay_pump(io, relay);
+}
+
+static void
+handle_splice_in(struct io_uring* io, struct relay* relay,
+                 struct io_uring_cqe* cqe) {
+    relay->receiving = false;
+    if (cqe->res < 0) {
+        fprintf(stderr, "error: splice failed: %s\n", strerror(-cqe->res));
+        session_close(relay->session);
+        return;
+    }
+
+    /* nothing spliced means the peer hung up */
+    if (cqe->res == 0) {
+        relay->eof = true;
     }
-    io_uring_sqe_set_data(sqe, relay);
-    io_uring_cqe_seen(io, cqe);
+
+    /* the filled pipe drains after the other one, fill that one next */
+    if (cqe->res > 0) {
+        relay->piped[relay->fill] = (size_t) cqe->res;
+        relay->fill ^= 1;
+    }
+
+    relay_pump(io, relay);
 }
 
 static void
-proxy(struct relay* client, struct relay* server) {
-    printf("Initializing io_uring\n");
-    struct io_uring io = {0};
-    if (io_uring_queue_init(64, &io, 0) != 0) {
-        perror("io_uring_queue_init");
+handle_splice_out(struct io_uring* io, struct relay* relay,
+                  struct io_uring_cqe* cqe) {
+    relay->sending = false;
+    if (cqe->res < 0) {
+        fprintf(stderr, "error: splice failed: %s\n", strerror(-cqe->res));
+        session_close(relay->session);
         return;
     }
 
-    /* stage the initial receive from the client */
-    struct io_uring_sqe* sqe = io_uring_get_sqe(&io);
-    client->phase = PHASE_RECEIVE;
-    io_uring_prep_recv(sqe, client->from, client->buffer.data, client->buffer.capacity, 0);
-    io_uring_sqe_set_data(sqe, client);
+    size_t const bytes_out = (size_t) cqe->res;
+    relay->piped[relay->drain] -= bytes_out;
+    relay->total += bytes_out;
+    if (relay->piped[relay->drain] == 0) {
+        relay->drain ^= 1;
+    }
 
-    /* and the initial receive from the server */
-    sqe = io_uring_get_sqe(&io);
-    server->phase = PHASE_RECEIVE;
-    io_uring_prep_recv(sqe, server->from, server->buffer.data, server->buffer.capacity, 0);
-    io_uring_sqe_set_data(sqe, server);
+    relay_pump(io, relay);
+}
+
+static void
+handle_completion(struct worker* w, struct io_uring_cqe* cqe) {
+    uint64_t const data = io_uring_cqe_get_data64(cqe);
+    enum op const op = (enum op) (data & OP_MASK);
+    struct relay* relay = (struct relay*) (uintptr_t) (data & ~(uint64_t) OP_MASK);
+    if (op == OP_ACCEPT) {
+        handle_accept(w, cqe);
+        return;
+    }
+
+    struct session* s = relay->session;
+    assert(s->pending > 0);
+    s->pending--;
+
+    switch (op) {
+        case OP_CONNECT:
+            handle_connect(&w->io, relay, cqe);
+            break;
+
+        case OP_RECEIVE:
+            handle_receive(&w->io, relay, cqe);
+            break;
+
+        case OP_SEND:
+            handle_send(&w->io, relay, cqe);
+            break;
+
+        case OP_SPLICE_IN:
+            handle_splice_in(&w->io, relay, cqe);
+            break;
+
+        case OP_SPLICE_OUT:
+            handle_splice_out(&w->io, relay, cqe);
+            break;
+
+        default:
+            break;
+    }
+
+    /* release the session after its last operation completed */
+    if (s->closing && s->pending == 0) {
+        session_end(w, s);
+    }
+}
+
+static void*
+proxy(void* arg) {
+    struct worker* w = arg;
+
+    /* keep the worker on its cpu, the ring and sessions stay cache-local */
+    if (w->cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(w->cpu, &cpus);
+        int const err = pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus);
+        if (err != 0) {
+            fprintf(stderr, "error: could not pin worker %u to cpu %d: %s\n",
+                    w->index, w->cpu, strerror(err));
+        }
+    }
+
+    printf("Initializing io_uring for worker %u\n", w->index);
+    if (io_uring_queue_init(RING_ENTRIES, &w->io, 0) != 0) {
+        perror("io_uring_queue_init");
+        return NULL;
+    }
+
+    /* receives draw from these instead of a buffer per connection */
+    int err = buf_pool_init(&w->io, &w->client_bufs, CLIENT_BUFFER_GROUP,
+                            CLIENT_BUFFER_COUNT, CLIENT_BUFFER_SIZE);
+    if (err == 0) {
+        err = buf_pool_init(&w->io, &w->server_bufs, SERVER_BUFFER_GROUP,
+                            SERVER_BUFFER_COUNT, SERVER_BUFFER_SIZE);
+        if (err != 0) {
+            buf_pool_end(&w->io, &w->client_bufs);
+        }
+    }
+
+    if (err != 0) {
+        fprintf(stderr, "error: could not register buffer ring: %s\n", strerror(-err));
+        io_uring_queue_exit(&w->io);
+        return NULL;
+    }
+
+    printf("Waiting for client connections\n");
+    queue_accept(w);
 
     /* i/o loop */
     while (true) {
-        if (io_uring_submit(&io) < 0) {
-            perror("io_uring_submit");
+        if (io_uring_submit_and_wait(&w->io, 1) < 0) {
+            perror("io_uring_submit_and_wait");
             break;
         }
 
+        /* handle every completion that is ready */
+        unsigned head;
+        unsigned count = 0;
         struct io_uring_cqe* cqe;
-        if (io_uring_wait_cqe(&io, &cqe) < 0) {
-            perror("io_uring_wait_cqe");
-            break;
+        io_uring_for_each_cqe(&w->io, head, cqe) {
+            handle_completion(w, cqe);
+            count++;
         }
+        io_uring_cq_advance(&w->io, count);
+    }
 
-        struct relay* relay = io_uring_cqe_get_data(cqe);
-        if (relay->phase == PHASE_RECEIVE) {
-            handle_receive(&io, relay, cqe);
-        } else if (relay->phase == PHASE_SEND) {
-            handle_send(&io, relay, cqe);
-        }
+    buf_pool_end(&w->io, &w->server_bufs);
+    buf_pool_end(&w->io, &w->client_bufs);
+    io_uring_queue_exit(&w->io);
+    pkt_pool_thread_end();
+    return NULL;
+}
+
+/*
+ * opens a listening socket, every worker binds its own to the same port and
+ * the kernel balances incoming connections between them
+ */
+static int
+open_listener(struct addrinfo const* info) {
+    int const fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    if (fd == -1) {
+        perror("failed to get a socket fd");
+        return -1;
     }
 
-    io_uring_queue_exit(&io);
+    int const yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes);
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof yes) == -1) {
+        perror("failed to set SO_REUSEPORT");
+        close(fd);
+        return -1;
+    }
+
+    if (bind(fd, info->ai_addr, info->ai_addrlen) == -1) {
+        perror("failed to bind");
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, SOMAXCONN) == -1) {
+        perror("failed to listen");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * most workers -t takes for every online cpu
+ */
+#define THREADS_PER_CPU 4
+
+/*
+ * parses the worker count, a whole unsigned number from one up to
+ * THREADS_PER_CPU for every online cpu
+ */
+static bool
+parse_threads(char const* arg, unsigned* threads) {
+    if (!isdigit((unsigned char) arg[0])) {
+        return false;
+    }
+
+    long const cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long const max = THREADS_PER_CPU * (unsigned long) (cpus > 0 ? cpus : 1);
+
+    char* end;
+    errno = 0;
+    unsigned long const n = strtoul(arg, &end, 10);
+    if (errno != 0 || *end != '\0' || n == 0 || n > max) {
+        return false;
+    }
+
+    *threads = (unsigned) n;
+    return true;
+}
+
+static void
+usage(void) {
+    fprintf(stderr, "Usage: proxy [-t THREADS] [-p] [-s] [-H]\n");
+    fprintf(stderr, "  -t THREADS  number of workers, one ring each (default 1, at most 4 per cpu)\n");
+    fprintf(stderr, "  -p          pin each worker to its own cpu\n");
+    fprintf(stderr, "  -s          passthrough mode, splice without decoding\n");
+    fprintf(stderr, "  -H          back buffers with hugepages\n");
 }
 
 int main(int argc, char** argv) {
     setbuf(stdout, NULL);
 
+    unsigned threads = 1;
+    bool pin = false;
+    enum relay_mode mode = MODE_COPY;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:psH")) != -1) {
+        switch (opt) {
+            case 't':
+                if (!parse_threads(optarg, &threads)) {
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'p':
+                pin = true;
+                break;
+
+            case 's':
+                mode = MODE_SPLICE;
+                break;
+
+            case 'H':
+                pkt_pool_hugepages(true);
+                break;
+
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
     int status;
     struct addrinfo hints = {0};
     hints.ai_family = AF_INET;
     hints.ai_socktype = SOCK_STREAM;
     hints.ai_flags = AI_PASSIVE;
 
-    /* sit on port 25566 and wait for a connection */
+    /* sit on port 25566 and wait for connections */
     struct addrinfo* proxy_info;
     if ((status = getaddrinfo(NULL, "25566", &hints, &proxy_info)) != 0) {
         perror("failed to get address info");
         return EXIT_FAILURE;
     }
 
-    int proxy_fd = socket(proxy_info->ai_family, proxy_info->ai_socktype, proxy_info->ai_protocol);
-    if (proxy_fd == -1) {
-        perror("failed to get a socket fd");
-        return EXIT_FAILURE;
-    }
-
-    int const yes = 1;
-    setsockopt(proxy_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes);
+    /* resolve the server once, every session connects to it */
+    hints = (struct addrinfo){0};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
 
-    if (bind(proxy_fd, proxy_info->ai_addr, proxy_info->ai_addrlen) == -1) {
-        perror("failed to bind");
+    struct addrinfo* server_info;
+    if (getaddrinfo(NULL, "25565", &hints, &server_info) != 0) {
+        perror("getaddrinfo");
         return EXIT_FAILURE;
     }
 
-    if (listen(proxy_fd, 1) == -1) {
-        perror("failed to listen");
+    struct worker* workers = calloc(threads, sizeof *workers);
+    if (workers == NULL) {
+        perror("calloc");
         return EXIT_FAILURE;
     }
 
-    while (true) {
-        printf("Waiting for client connection\n");
-
-        /* wait for the client to connect */
-        struct sockaddr_storage client_addr;
-        socklen_t client_len = sizeof client_addr;
-        int client_fd = accept(proxy_fd, (struct sockaddr*) &client_addr, &client_len);
-        if (client_fd == -1) {
-            perror("failed to accept client connection");
-            return EXIT_FAILURE;
-        }
-
-        printf("Accepted client connection\n");
-
-        /* connect to the server on the client's behalf */
-        hints = (struct addrinfo){0};
-        hints.ai_family = AF_INET;
-        hints.ai_socktype = SOCK_STREAM;
-        hints.ai_flags = AI_PASSIVE;
-
-        struct addrinfo* server_info;
-        if (getaddrinfo(NULL, "25565", &hints, &server_info) != 0) {
-            perror("getaddrinfo");
-            return EXIT_FAILURE;
-        }
-
-        int server_fd = socket(server_info->ai_family, server_info->ai_socktype, server_info->ai_protocol);
-        if (server_fd == -1) {
-            perror("socket");
+    /* bind every listener up front so errors are reported before serving */
+    long const cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (unsigned i = 0; i < threads; i++) {
+        int const fd = open_listener(proxy_info);
+        if (fd == -1) {
             return EXIT_FAILURE;
         }
 
-        if (connect(server_fd, server_info->ai_addr, server_info->ai_addrlen) == -1) {
-            perror("connect");
-            return EXIT_FAILURE;
-        }
-
-        struct relay client = {.from = client_fd, .to = server_fd};
-        if (pkt_buffer_init(&client.buffer, 512) == NULL) {
-            perror("reader_init");
-            return EXIT_FAILURE;
-        }
+        workers[i] = (struct worker){
+            .index = i,
+            .cpu = pin && cpus > 0 ? (int) (i % (unsigned long) cpus) : -1,
+            .listen_fd = fd,
+            .server_info = server_info,
+            .mode = mode,
+        };
+    }
 
-        struct relay server = {.from = server_fd, .to = client_fd};
-        if (pkt_buffer_init(&server.buffer, 1024 * 16) == NULL) {
-            perror("reader_init");
+    for (unsigned i = 0; i < threads; i++) {
+        int const err = pthread_create(&workers[i].thread, NULL, proxy, &workers[i]);
+        if (err != 0) {
+            fprintf(stderr, "error: could not start worker: %s\n", strerror(err));
             return EXIT_FAILURE;
         }
+    }
 
-        printf("Connected to server\n");
-        proxy(&client, &server);
-
-        /* we're done! */
-        printf("Connections closed\n");
-        pkt_buffer_end(&server.buffer);
-        pkt_buffer_end(&client.buffer);
-        close(server_fd);
-        close(client_fd);
+    for (unsigned i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        close(workers[i].listen_fd);
     }
 
-    close(proxy_fd);
+    free(workers);
+    freeaddrinfo(server_info);
     freeaddrinfo(proxy_info);
     return 0;
 }
@@ -0,0 +1,245 @@
+/*
+ * records.c: binary packet records
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "records.h"
+
+static char const magic[4] = {'O', 'B', 'R', 'C'};
+
+/*
+ * the columns of a field, as a c type and the member holding it
+ */
+#define COLUMNS_i8(C, name) C(PKT_CTYPE_i8, name)
+#define COLUMNS_i16(C, name) C(PKT_CTYPE_i16, name)
+#define COLUMNS_i32(C, name) C(PKT_CTYPE_i32, name)
+#define COLUMNS_i64(C, name) C(PKT_CTYPE_i64, name)
+#define COLUMNS_f32(C, name) C(PKT_CTYPE_f32, name)
+#define COLUMNS_f64(C, name) C(PKT_CTYPE_f64, name)
+#define COLUMNS_bool(C, name) C(PKT_CTYPE_bool, name)
+#define COLUMNS_eid(C, name) C(PKT_CTYPE_eid, name)
+#define COLUMNS_f27_5(C, name) C(PKT_CTYPE_f27_5, name)
+#define COLUMNS_anim(C, name) C(PKT_CTYPE_anim, name)
+
+/* coordinates are split, their padding would leak garbage */
+#define COLUMNS_c_coords(C, name) C(mc_i32, name.x) C(mc_i32, name.z)
+#define COLUMNS_b_coords(C, name) C(mc_i32, name.x) C(mc_i16, name.y) C(mc_i32, name.z)
+#define COLUMNS_extent(C, name) C(mc_i8, name.x) C(mc_i8, name.y) C(mc_i8, name.z)
+
+/*
+ * the width of every column of a packet, ending at the first zero
+ */
+#define WIDTH_C(ctype, member) sizeof(ctype),
+#define WIDTH_F(type, name, prefix, style) COLUMNS_##type(WIDTH_C, name)
+#define WIDTH_V(name, length, scale, prefix, style) sizeof(uint64_t), sizeof(uint32_t),
+
+#define WIDTHS(PFX, pfx, NAME, name, id, label, print, suffix) \
+    [id] = { \
+        sizeof(uint64_t), \
+        sizeof(uint32_t), \
+        PKT_IF_FIELDS_##print(PKT_FIELDS(PFX, NAME, WIDTH_F, WIDTH_V)) \
+    },
+
+static size_t const widths[256][RECORDS_MAX_COLUMNS] = {
+    SRV_PACKETS(WIDTHS)
+};
+
+void
+records_write_header(struct fmt* out) {
+    assert(out != NULL);
+
+    struct records_header header = {.version = RECORDS_VERSION};
+    memcpy(header.magic, magic, sizeof magic);
+    fmt_bytes(out, &header, sizeof header);
+}
+
+void
+records_init(struct records* rec, struct fmt* out) {
+    assert(rec != NULL);
+    assert(out != NULL);
+
+    *rec = (struct records){.out = out};
+}
+
+static size_t
+pad8(size_t const n) {
+    return (n + 7) & ~(size_t) 7;
+}
+
+static void
+write_block(struct records* rec, mc_byte const id) {
+    struct records_block* b = &rec->block[id];
+    size_t const* width = widths[id];
+
+    struct records_block_header header = {
+        .id = id,
+        .count = (uint32_t) b->count,
+    };
+    for (size_t c = 0; c < RECORDS_MAX_COLUMNS && width[c] != 0; c++) {
+        header.size += pad8(b->count * width[c]);
+    }
+    fmt_bytes(rec->out, &header, sizeof header);
+
+    /* only the part of every column that is filled is written */
+    static uint8_t const zeros[8];
+    uint8_t const* column = b->data;
+    for (size_t c = 0; c < RECORDS_MAX_COLUMNS && width[c] != 0; c++) {
+        size_t const len = b->count * width[c];
+        fmt_bytes(rec->out, column, len);
+        fmt_bytes(rec->out, zeros, pad8(len) - len);
+        column += RECORDS_PER_BLOCK * width[c];
+    }
+
+    b->count = 0;
+}
+
+/*
+ * the block the next record of an id goes to, with room for it
+ */
+static struct records_block*
+next_block(struct records* rec, mc_byte const id) {
+    struct records_block* b = &rec->block[id];
+    if (b->data == NULL) {
+        size_t row = 0;
+        for (size_t c = 0; c < RECORDS_MAX_COLUMNS && widths[id][c] != 0; c++) {
+            row += widths[id][c];
+        }
+
+        b->data = malloc(RECORDS_PER_BLOCK * row);
+        if (b->data == NULL) {
+            fprintf(stderr, "error: could not allocate record block\n");
+            exit(EXIT_FAILURE);
+        }
+    } else if (b->count == RECORDS_PER_BLOCK) {
+        write_block(rec, id);
+    }
+    return b;
+}
+
+/*
+ * writes out the only record of a block as a row, and empties the block
+ */
+static void
+write_row(struct records* rec, mc_byte const id) {
+    struct records_block* b = &rec->block[id];
+    size_t const* width = widths[id];
+    assert(b->count == 1);
+
+    fmt_bytes(rec->out, &id, sizeof id);
+    uint8_t const* column = b->data;
+    for (size_t c = 0; c < RECORDS_MAX_COLUMNS && width[c] != 0; c++) {
+        fmt_bytes(rec->out, column, width[c]);
+        column += RECORDS_PER_BLOCK * width[c];
+    }
+
+    b->count = 0;
+}
+
+/*
+ * stores value i of a column, and returns the next column
+ */
+static uint8_t*
+put(uint8_t* column, size_t const i, void const* v, size_t const width) {
+    memcpy(&column[i * width], v, width);
+    return &column[RECORDS_PER_BLOCK * width];
+}
+
+/*
+ * handlers store a packet column by column. at follows the fields through
+ * the payload, so byte payloads can refer back into the capture.
+ */
+#define STORE_C(ctype, member) column = put(column, i, &pkt->member, sizeof(ctype));
+#define STORE_F(type, name, prefix, style) \
+    COLUMNS_##type(STORE_C, name) \
+    at += PKT_SIZE_##type;
+#define STORE_V(name, length, scale, prefix, style) \
+    uint64_t const ref_##name = at; \
+    uint32_t const len_##name = (uint32_t) (pkt->length * scale); \
+    column = put(column, i, &ref_##name, sizeof ref_##name); \
+    column = put(column, i, &len_##name, sizeof len_##name); \
+    at += len_##name;
+
+#define STORE_FIELDS(PFX, pfx, NAME, name) \
+    struct pfx##_pkt_##name const* pkt = p; \
+    uint64_t at = offset + sizeof pkt_id; \
+    PKT_FIELDS(PFX, NAME, STORE_F, STORE_V) \
+    (void) at;
+
+#define RECORDER(PFX, pfx, NAME, name, id, label, print, suffix) \
+    static void \
+    record_##pfx##_pkt_##name(void* ctx, mc_byte const pkt_id, void const* p, \
+                              size_t const offset, size_t const length) { \
+        struct records* rec = ctx; \
+        struct records_block* b = next_block(rec, pkt_id); \
+        size_t const i = b->count++; \
+        uint64_t const at_offset = offset; \
+        uint32_t const at_length = (uint32_t) length; \
+        uint8_t* column = put(b->data, i, &at_offset, sizeof at_offset); \
+        column = put(column, i, &at_length, sizeof at_length); \
+        PKT_IF_FIELDS_##print(STORE_FIELDS(PFX, pfx, NAME, name)) \
+        (void) p; \
+        (void) column; \
+        if (rec->rows) { \
+            write_row(rec, pkt_id); \
+        } \
+    }
+
+SRV_PACKETS(RECORDER)
+
+#define REGISTER(PFX, pfx, NAME, name, id, label, print, suffix) \
+    pkt_table_register(t, PFX##_##NAME, record_##pfx##_pkt_##name);
+
+void
+records_register(struct pkt_table* t) {
+    assert(t != NULL);
+
+    *t = pkt_srv_table;
+    SRV_PACKETS(REGISTER)
+}
+
+void
+records_add_rows(struct records* rec, uint8_t const* rows, size_t const len) {
+    assert(rec != NULL);
+    assert(!rec->rows);
+    assert(rows != NULL || len == 0);
+
+    size_t at = 0;
+    while (at < len) {
+        mc_byte const id = rows[at];
+        at += sizeof id;
+
+        struct records_block* b = next_block(rec, id);
+        size_t const i = b->count++;
+        uint8_t* column = b->data;
+        for (size_t c = 0; c < RECORDS_MAX_COLUMNS && widths[id][c] != 0; c++) {
+            assert(at + widths[id][c] <= len);
+            column = put(column, i, &rows[at], widths[id][c]);
+            at += widths[id][c];
+        }
+    }
+}
+
+void
+records_flush(struct records* rec) {
+    assert(rec != NULL);
+
+    for (size_t id = 0; id < 256; id++) {
+        if (rec->block[id].count > 0) {
+            write_block(rec, (mc_byte) id);
+        }
+    }
+}
+
+void
+records_end(struct records* rec) {
+    assert(rec != NULL);
+
+    records_flush(rec);
+    for (size_t id = 0; id < 256; id++) {
+        free(rec->block[id].data);
+    }
+    *rec = (struct records){0};
+}
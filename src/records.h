@@ -0,0 +1,99 @@
+/*
+ * records.h: binary packet records
+ */
+
+#ifndef OBSIDIAN_RECORDS_H
+#define OBSIDIAN_RECORDS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "format.h"
+#include "packet/dispatch.h"
+
+#define RECORDS_VERSION 1
+
+/*
+ * records a block holds before it is written, and the most columns a packet
+ * can have
+ */
+#define RECORDS_PER_BLOCK 4096u
+#define RECORDS_MAX_COLUMNS 16
+
+/*
+ * Records are decoded packets in a fixed layout, for tools that should not
+ * have to parse text. Everything is in native byte order. The output starts
+ * with a header, followed by blocks that each hold records of one packet
+ * id. Blocks of different ids are interleaved. The offsets give back the
+ * order of the capture.
+ *
+ * A block stores its records column by column. It starts with the offset
+ * of each packet as uint64, then its payload length as uint32. Then every
+ * field follows in schema order, as its c type from types.h. Coordinates
+ * get a column per member. A byte payload is not copied. It is stored as a
+ * uint64 column of offsets into the capture and a uint32 column of lengths.
+ * Every column is padded to a multiple of 8 bytes.
+ */
+struct records_header {
+    char magic[4]; /* "OBRC" */
+    uint32_t version;
+};
+
+struct records_block_header {
+    uint8_t id;
+    uint8_t reserved[3];
+    uint32_t count; /* records in the block */
+    uint64_t size; /* bytes of columns that follow */
+};
+
+/*
+ * records of one id that are not written yet, RECORDS_PER_BLOCK values are
+ * reserved for every column
+ */
+struct records_block {
+    uint8_t* data;
+    size_t count;
+};
+
+struct records {
+    struct fmt* out;
+    struct records_block block[256];
+    bool rows; /* written as rows instead, see records_add_rows */
+};
+
+void
+records_write_header(struct fmt* out);
+
+void
+records_init(struct records* rec, struct fmt* out);
+
+/*
+ * copies the server table and registers a handler for every packet, the
+ * handlers take the records as their context
+ */
+void
+records_register(struct pkt_table* t);
+
+/*
+ * adds records written as rows by another records, in their order. a row is
+ * the packet id followed by one value of every column, unpadded. records
+ * split into rows this way and added back block the same as if they had
+ * been recorded here.
+ */
+void
+records_add_rows(struct records* rec, uint8_t const* rows, size_t len);
+
+/*
+ * writes every block that has records, even when it is not full
+ */
+void
+records_flush(struct records* rec);
+
+/*
+ * flushes and frees the blocks
+ */
+void
+records_end(struct records* rec);
+
+#endif //OBSIDIAN_RECORDS_H
@@ -0,0 +1,232 @@
+/*
+ * stats.c: capture statistics
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "stats.h"
+
+void
+stats_init(struct stats* s) {
+    assert(s != NULL);
+
+    *s = (struct stats){0};
+    for (size_t id = 0; id < 256; id++) {
+        s->min[id] = UINT64_MAX;
+    }
+}
+
+static size_t
+bucket(uint64_t const v) {
+    if (v == 0) {
+        return 0;
+    }
+
+    size_t const k = (size_t) (64 - __builtin_clzll(v));
+    return k < STATS_BUCKETS ? k : STATS_BUCKETS - 1;
+}
+
+static size_t
+entity_slot(struct stats_entity const* entities, size_t const capacity,
+            entity_id const entity) {
+    size_t i = ((uint32_t) entity * 2654435761u) & (capacity - 1);
+    while (entities[i].count != 0 && entities[i].entity != entity) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return i;
+}
+
+static void
+grow_entities(struct stats* s) {
+    size_t const capacity = s->entity_capacity == 0 ? 1024 : s->entity_capacity * 2;
+    struct stats_entity* entities = calloc(capacity, sizeof *entities);
+    if (entities == NULL) {
+        fprintf(stderr, "error: could not allocate entity counters\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < s->entity_capacity; i++) {
+        if (s->entities[i].count != 0) {
+            entities[entity_slot(entities, capacity, s->entities[i].entity)] = s->entities[i];
+        }
+    }
+
+    free(s->entities);
+    s->entities = entities;
+    s->entity_capacity = capacity;
+}
+
+static void
+count_entity(struct stats* s, entity_id const entity) {
+    /* keep the table at most three quarters full */
+    if (4 * (s->entity_count + 1) > 3 * s->entity_capacity) {
+        grow_entities(s);
+    }
+
+    struct stats_entity* e = &s->entities[entity_slot(s->entities, s->entity_capacity, entity)];
+    if (e->count == 0) {
+        e->entity = entity;
+        s->entity_count++;
+    }
+    e->count++;
+}
+
+static void
+count_packet(void* ctx, mc_byte const id, void const* pkt, size_t const offset,
+             size_t const length) {
+    struct stats* s = ctx;
+    (void) offset;
+
+    s->count[id]++;
+    s->bytes[id] += sizeof id + length;
+    s->min[id] = length < s->min[id] ? length : s->min[id];
+    s->max[id] = length > s->max[id] ? length : s->max[id];
+    s->sizes[bucket(length)]++;
+
+    /* a packet about two entities counts for both */
+    pkt_entity const get_entities = pkt_srv_table.entry[id].entity;
+    if (get_entities != NULL) {
+        entity_id entities[PKT_MAX_ENTITIES];
+        size_t const n = get_entities(pkt, entities);
+        for (size_t i = 0; i < n; i++) {
+            if (!pkt_entity_repeated(entities, i)) {
+                count_entity(s, entities[i]);
+            }
+        }
+    }
+}
+
+static void
+count_chunk_data(void* ctx, mc_byte const id, void const* pkt, size_t const offset,
+                 size_t const length) {
+    struct stats* s = ctx;
+    struct srv_pkt_chunk_data const* chunk = pkt;
+
+    count_packet(ctx, id, pkt, offset, length);
+    s->compressed[bucket((uint64_t) chunk->compressed_size)]++;
+}
+
+#define REGISTER(PFX, pfx, NAME, name, id, label, print, suffix) \
+    pkt_table_register(t, PFX##_##NAME, count_packet);
+
+void
+stats_register(struct pkt_table* t) {
+    assert(t != NULL);
+
+    *t = pkt_srv_table;
+    SRV_PACKETS(REGISTER)
+    pkt_table_register(t, SRV_CHUNK_DATA, count_chunk_data);
+}
+
+static double
+share(uint64_t const part, uint64_t const whole) {
+    return whole == 0 ? 0.0 : 100.0 * (double) part / (double) whole;
+}
+
+static void
+print_histogram(uint64_t const* buckets, FILE* out) {
+    uint64_t most = 0;
+    for (size_t k = 0; k < STATS_BUCKETS; k++) {
+        most = buckets[k] > most ? buckets[k] : most;
+    }
+
+    for (size_t k = 0; k < STATS_BUCKETS; k++) {
+        if (buckets[k] == 0) {
+            continue;
+        }
+
+        uint64_t const lo = k == 0 ? 0 : UINT64_C(1) << (k - 1);
+        uint64_t const hi = UINT64_C(1) << k;
+        int const bar = (int) ((buckets[k] * 40 + most - 1) / most);
+        fprintf(out, "  [%10" PRIu64 ", %10" PRIu64 ")  %12" PRIu64 "  %.*s\n",
+                lo, hi, buckets[k], bar, "########################################");
+    }
+}
+
+static int
+compare_entities(void const* a, void const* b) {
+    struct stats_entity const* x = a;
+    struct stats_entity const* y = b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    return x->entity < y->entity ? -1 : x->entity > y->entity;
+}
+
+void
+stats_print(struct stats const* s, FILE* out) {
+    assert(s != NULL);
+    assert(out != NULL);
+
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    for (size_t id = 0; id < 256; id++) {
+        packets += s->count[id];
+        bytes += s->bytes[id];
+    }
+
+    fprintf(out, "Packets by id:\n");
+    fprintf(out, "  id  name            %12s  %14s  %6s  %10s  %10s\n",
+            "packets", "bytes", "share", "min size", "max size");
+    for (size_t id = 0; id < 256; id++) {
+        if (s->count[id] == 0) {
+            continue;
+        }
+
+        fprintf(out, "  %02zx  %-15s %12" PRIu64 "  %14" PRIu64 "  %5.1f%%  %10" PRIu64 "  %10" PRIu64 "\n",
+                id, pkt_srv_table.entry[id].name, s->count[id], s->bytes[id],
+                share(s->bytes[id], bytes), s->min[id], s->max[id]);
+    }
+    fprintf(out, "  total               %12" PRIu64 "  %14" PRIu64 "\n", packets, bytes);
+
+    uint64_t movement = 0;
+    for (size_t id = SRV_ENT_MOVE; id <= SRV_ENT_FULL_POS; id++) {
+        movement += s->bytes[id];
+    }
+    uint64_t const chunks = s->bytes[SRV_CHUNK_DATA];
+
+    fprintf(out, "\nBytes by kind:\n");
+    fprintf(out, "  chunk data (33)     %14" PRIu64 "  %5.1f%%\n", chunks, share(chunks, bytes));
+    fprintf(out, "  movement (1f-22)    %14" PRIu64 "  %5.1f%%\n", movement, share(movement, bytes));
+    fprintf(out, "  other               %14" PRIu64 "  %5.1f%%\n",
+            bytes - chunks - movement, share(bytes - chunks - movement, bytes));
+
+    fprintf(out, "\nPayload sizes:\n");
+    print_histogram(s->sizes, out);
+
+    if (s->count[SRV_CHUNK_DATA] > 0) {
+        fprintf(out, "\nChunk data compressed_size:\n");
+        print_histogram(s->compressed, out);
+    }
+
+    /* sort a copy, the table has to keep its order */
+    struct stats_entity* top = malloc((s->entity_count > 0 ? s->entity_count : 1) * sizeof *top);
+    if (top == NULL) {
+        fprintf(stderr, "error: could not allocate entity list\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < s->entity_capacity; i++) {
+        if (s->entities[i].count != 0) {
+            top[n++] = s->entities[i];
+        }
+    }
+    qsort(top, n, sizeof *top, compare_entities);
+
+    fprintf(out, "\nMost active entities (%zu seen):\n", n);
+    for (size_t i = 0; i < n && i < STATS_TOP_ENTITIES; i++) {
+        fprintf(out, "  %08x  %12" PRIu64 "\n", (unsigned) top[i].entity, top[i].count);
+    }
+    free(top);
+}
+
+void
+stats_end(struct stats* s) {
+    assert(s != NULL);
+
+    free(s->entities);
+    *s = (struct stats){0};
+}
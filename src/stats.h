@@ -0,0 +1,65 @@
+/*
+ * stats.h: capture statistics
+ */
+
+#ifndef OBSIDIAN_STATS_H
+#define OBSIDIAN_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "packet/dispatch.h"
+
+/*
+ * bucket 0 counts zeroes, bucket k counts values in [2^(k-1), 2^k)
+ */
+#define STATS_BUCKETS 33
+
+/*
+ * entities with the most packets that are listed
+ */
+#define STATS_TOP_ENTITIES 10
+
+struct stats_entity {
+    entity_id entity;
+    uint64_t count;
+};
+
+/*
+ * counters only, packets are never formatted
+ */
+struct stats {
+    uint64_t count[256];
+    uint64_t bytes[256]; /* ids included */
+    uint64_t min[256]; /* payload sizes */
+    uint64_t max[256];
+    uint64_t sizes[STATS_BUCKETS]; /* payload sizes of all packets */
+    uint64_t compressed[STATS_BUCKETS]; /* compressed_size of chunk data */
+
+    /* packets per entity, open addressing with empty slots at count 0 */
+    struct stats_entity* entities;
+    size_t entity_count;
+    size_t entity_capacity;
+};
+
+void
+stats_init(struct stats* s);
+
+/*
+ * copies the server table and registers a handler for every packet, the
+ * handlers take the stats as their context
+ */
+void
+stats_register(struct pkt_table* t);
+
+/*
+ * prints a summary of everything counted
+ */
+void
+stats_print(struct stats const* s, FILE* out);
+
+void
+stats_end(struct stats* s);
+
+#endif //OBSIDIAN_STATS_H
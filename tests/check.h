@@ -0,0 +1,22 @@
+/*
+ * check.h: test assertions
+ */
+
+#ifndef OBSIDIAN_CHECK_H
+#define OBSIDIAN_CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * fails the test, unlike assert this is never compiled out
+ */
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(EXIT_FAILURE); \
+        } \
+    } while (0)
+
+#endif //OBSIDIAN_CHECK_H
@@ -0,0 +1,109 @@
+/*
+ * framer.c: tests for incremental packet framing
+ */
+
+#include <string.h>
+
+#include "check.h"
+#include "packet/framer.h"
+
+#define MAX_PACKETS 8
+
+struct stream {
+    uint8_t data[1024];
+    size_t len;
+    size_t ends[MAX_PACKETS]; /* where each packet ends */
+    size_t packets;
+};
+
+static void
+put(struct stream* s, void const* bytes, size_t const n) {
+    CHECK(s->len + n <= sizeof s->data);
+    memcpy(&s->data[s->len], bytes, n);
+    s->len += n;
+}
+
+static void
+put_i16(struct stream* s, int16_t const x) {
+    uint8_t const b[] = {(uint8_t) (x >> 8), (uint8_t) x};
+    put(s, b, sizeof b);
+}
+
+static void
+put_i32(struct stream* s, int32_t const x) {
+    uint8_t const b[] = {(uint8_t) (x >> 24), (uint8_t) (x >> 16), (uint8_t) (x >> 8), (uint8_t) x};
+    put(s, b, sizeof b);
+}
+
+static void
+end_packet(struct stream* s) {
+    CHECK(s->packets < MAX_PACKETS);
+    s->ends[s->packets++] = s->len;
+}
+
+static void
+put_handshake(struct stream* s, size_t const username, size_t const password) {
+    uint8_t name[256];
+    CHECK(username <= sizeof name && password <= sizeof name);
+    memset(name, 'a', sizeof name);
+
+    uint8_t const id = CLI_HANDSHAKE;
+    put(s, &id, sizeof id);
+    put_i32(s, 14);
+    put_i16(s, (int16_t) username);
+    put(s, name, username);
+    put_i16(s, (int16_t) password);
+    put(s, name, password);
+    end_packet(s);
+}
+
+static void
+put_grounded(struct stream* s) {
+    uint8_t const pkt[] = {CLI_GROUNDED, 1};
+    put(s, pkt, sizeof pkt);
+    end_packet(s);
+}
+
+/*
+ * feeds the stream in pieces of the given size, every packet has to end
+ * exactly where it does in the stream
+ */
+static void
+feed_in_pieces(struct stream const* s, size_t const piece) {
+    struct pkt_framer f;
+    pkt_framer_init(&f, &pkt_cli_table);
+
+    for (size_t off = 0; off < s->len; off += piece) {
+        size_t const n = piece < s->len - off ? piece : s->len - off;
+        size_t const before = f.packets;
+        size_t const framed = pkt_framer_feed(&f, &s->data[off], n);
+
+        CHECK(!f.lost);
+        CHECK(f.packets <= s->packets);
+        if (f.packets > before) {
+            CHECK(off + framed == s->ends[f.packets - 1]);
+        } else {
+            CHECK(framed == 0);
+        }
+    }
+
+    CHECK(f.packets == s->packets);
+    CHECK(f.staged == 0 && f.remaining == 0);
+    pkt_framer_end(&f);
+}
+
+int
+main(void) {
+    /* a long username puts the password length well past the stage */
+    struct stream s = {0};
+    put_handshake(&s, 100, 12);
+    put_grounded(&s);
+    put_handshake(&s, 200, 200);
+    put_handshake(&s, 3, 4);
+    put_grounded(&s);
+
+    for (size_t piece = 1; piece <= s.len; piece++) {
+        feed_in_pieces(&s, piece);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+/*
+ * moves.c: tests that every batch decoding path matches the packet readers
+ */
+
+#include <string.h>
+
+#include "check.h"
+#include "packet/dispatch.h"
+#include "packet/moves.h"
+
+#define PACKETS 1000
+
+static mc_byte stream[PACKETS * (sizeof(mc_byte) + SRV_PKT_ENT_FULL_POS_SIZE)];
+static size_t stream_len;
+
+/*
+ * what the packet readers make of every packet, and where each one ends
+ */
+static struct pkt_moves expected;
+static size_t ends[PACKETS + 1];
+static size_t packets;
+
+static uint32_t rng = 12345;
+
+static uint32_t
+next_random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+/*
+ * appends a packet with random fields, an entity id is never negative
+ */
+static void
+put_packet(mc_byte const id, size_t const size) {
+    CHECK(stream_len + sizeof id + size <= sizeof stream);
+    stream[stream_len] = id;
+    for (size_t i = 0; i < size; i++) {
+        stream[stream_len + sizeof id + i] = (mc_byte) next_random();
+    }
+    stream[stream_len + sizeof id] &= 0x7f;
+    stream_len += sizeof id + size;
+}
+
+static void
+expect(mc_byte const kind, entity_id const entity, mc_i32 const x, mc_i32 const y,
+       mc_i32 const z, mc_i8 const yaw, mc_i8 const pitch) {
+    size_t const i = expected.count++;
+    expected.kind[i] = kind;
+    expected.entity[i] = entity;
+    expected.x[i] = x;
+    expected.y[i] = y;
+    expected.z[i] = z;
+    expected.yaw[i] = yaw;
+    expected.pitch[i] = pitch;
+}
+
+/*
+ * decodes the stream one packet at a time with the readers
+ */
+static void
+read_expected(void) {
+    struct pkt_buffer r = {.data = stream, .cur = stream_len, .capacity = stream_len};
+    while (r.pos < r.cur) {
+        mc_byte id;
+        CHECK(read_packet_id(&r, &id) == 0);
+
+        union pkt_any pkt;
+        CHECK(pkt_srv_table.entry[id].decode(&r, &pkt) == 0);
+        switch (id) {
+            case SRV_ENT_MOVE: {
+                struct srv_pkt_ent_move const* p = &pkt.srv_pkt_ent_move;
+                expect(id, p->id, p->x, p->y, p->z, 0, 0);
+                break;
+            }
+
+            case SRV_ENT_LOOK: {
+                struct srv_pkt_ent_look const* p = &pkt.srv_pkt_ent_look;
+                expect(id, p->id, 0, 0, 0, p->yaw, p->pitch);
+                break;
+            }
+
+            case SRV_ENT_MOVE_LOOK: {
+                struct srv_pkt_ent_move_look const* p = &pkt.srv_pkt_ent_move_look;
+                expect(id, p->id, p->x, p->y, p->z, p->yaw, p->pitch);
+                break;
+            }
+
+            case SRV_ENT_FULL_POS: {
+                struct srv_pkt_ent_full_pos const* p = &pkt.srv_pkt_ent_full_pos;
+                expect(id, p->id, p->x, p->y, p->z, p->yaw, p->pitch);
+                break;
+            }
+
+            default:
+                /* a packet that ends a run, it gets an empty entry */
+                expect(id, 0, 0, 0, 0, 0, 0);
+                break;
+        }
+        ends[packets++] = r.pos;
+    }
+}
+
+/*
+ * decodes the stream in runs of at most capacity packets on the given path,
+ * every entry has to match the readers
+ */
+static void
+decode_all(enum pkt_moves_path const path, size_t const capacity) {
+    struct pkt_moves m;
+    CHECK(pkt_moves_init(&m, capacity) != NULL);
+    m.path = path;
+
+    size_t off = 0;
+    size_t next = 0;
+    while (off < stream_len) {
+        /* a packet that is not a move ends the run, step over it */
+        if (!pkt_moves_has(stream[off])) {
+            CHECK(pkt_moves_decode(&m, &stream[off], stream_len - off) == 0);
+            off = ends[next++];
+            continue;
+        }
+
+        m.count = 0;
+        size_t const used = pkt_moves_decode(&m, &stream[off], stream_len - off);
+        CHECK(used > 0);
+        CHECK(m.count <= capacity);
+
+        for (size_t i = 0; i < m.count; i++, next++) {
+            CHECK(m.kind[i] == expected.kind[next]);
+            CHECK(m.entity[i] == expected.entity[next]);
+            CHECK(m.x[i] == expected.x[next]);
+            CHECK(m.y[i] == expected.y[next]);
+            CHECK(m.z[i] == expected.z[next]);
+            CHECK(m.yaw[i] == expected.yaw[next]);
+            CHECK(m.pitch[i] == expected.pitch[next]);
+        }
+        off += used;
+        CHECK(off == ends[next - 1]);
+    }
+    CHECK(next == packets);
+
+    pkt_moves_end(&m);
+}
+
+/*
+ * a packet cut off at the end is left for the next call
+ */
+static void
+decode_truncated(enum pkt_moves_path const path) {
+    struct pkt_moves m;
+    CHECK(pkt_moves_init(&m, PACKETS) != NULL);
+    m.path = path;
+
+    for (size_t cut = 0; cut < 64; cut++) {
+        m.count = 0;
+        size_t const used = pkt_moves_decode(&m, stream, cut);
+
+        /* the stream begins with a run longer than any cut */
+        size_t whole = 0;
+        while (ends[whole] <= cut) {
+            whole++;
+        }
+        CHECK(m.count == whole);
+        CHECK(used == (whole == 0 ? 0 : ends[whole - 1]));
+    }
+    pkt_moves_end(&m);
+}
+
+int
+main(void) {
+    mc_byte const ids[] = {SRV_ENT_MOVE, SRV_ENT_LOOK, SRV_ENT_MOVE_LOOK, SRV_ENT_FULL_POS};
+    size_t const sizes[] = {
+        SRV_PKT_ENT_MOVE_SIZE,
+        SRV_PKT_ENT_LOOK_SIZE,
+        SRV_PKT_ENT_MOVE_LOOK_SIZE,
+        SRV_PKT_ENT_FULL_POS_SIZE,
+    };
+
+    /* mostly moves, with the odd other packet breaking up the runs */
+    for (size_t i = 0; i < PACKETS; i++) {
+        if (i % 97 == 96) {
+            put_packet(SRV_ENT_DESTROY, SRV_PKT_ENT_DESTROY_SIZE);
+        } else {
+            size_t const k = next_random() % 4;
+            put_packet(ids[k], sizes[k]);
+        }
+    }
+
+    CHECK(pkt_moves_init(&expected, PACKETS) != NULL);
+    read_expected();
+
+    size_t const capacities[] = {1, 3, 4, 5, 8, 9, 31, PACKETS};
+    enum pkt_moves_path const paths[] = {PKT_MOVES_SCALAR, PKT_MOVES_SSE41, PKT_MOVES_AVX2};
+    for (size_t p = 0; p < sizeof paths / sizeof paths[0]; p++) {
+        if (!pkt_moves_supports(paths[p])) {
+            fprintf(stderr, "skipping path %d, not supported here\n", (int) paths[p]);
+            continue;
+        }
+
+        for (size_t c = 0; c < sizeof capacities / sizeof capacities[0]; c++) {
+            decode_all(paths[p], capacities[c]);
+        }
+        decode_truncated(paths[p]);
+    }
+
+    pkt_moves_end(&expected);
+    return EXIT_SUCCESS;
+}
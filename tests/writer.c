@@ -0,0 +1,199 @@
+/*
+ * writer.c: tests that every packet the writers encode reads back the same
+ */
+
+#include <string.h>
+
+#include "check.h"
+#include "packet/dispatch.h"
+
+#define IOVECS 8
+
+/*
+ * large enough for every payload, at the largest length and scale used
+ */
+static mc_byte payload[4 * 256];
+
+/*
+ * distinct field values, derived from a counter
+ */
+#define SET_i8(x, n) x = (mc_i8) (n)
+#define SET_i16(x, n) x = (mc_i16) ((n) * 257)
+#define SET_i32(x, n) x = (mc_i32) ((n) * -16777259)
+#define SET_i64(x, n) x = (mc_i64) (n) * -1099511628211
+#define SET_f32(x, n) x = (mc_f32) (n) * -0.75f
+#define SET_f64(x, n) x = (mc_f64) (n) / 3.0
+#define SET_bool(x, n) x = ((n) & 1) != 0
+#define SET_eid(x, n) x = (entity_id) ((n) * 7919)
+#define SET_f27_5(x, n) x = (mc_f27_5) ((n) * -4099)
+#define SET_anim(x, n) x = ANIMATION_ARM_SWING
+#define SET_c_coords(x, n) x = (struct mc_c_coords){(n), -(n)}
+#define SET_b_coords(x, n) x = (struct mc_b_coords){(n) * 65599, (mc_i16) -(n), -(n)}
+#define SET_extent(x, n) x = (struct mc_extent){(mc_i8) (n), 15, (mc_i8) -(n)}
+
+#define EQ_i8(a, b) ((a) == (b))
+#define EQ_i16(a, b) ((a) == (b))
+#define EQ_i32(a, b) ((a) == (b))
+#define EQ_i64(a, b) ((a) == (b))
+#define EQ_f32(a, b) ((a) == (b))
+#define EQ_f64(a, b) ((a) == (b))
+#define EQ_bool(a, b) ((a) == (b))
+#define EQ_eid(a, b) ((a) == (b))
+#define EQ_f27_5(a, b) ((a) == (b))
+#define EQ_anim(a, b) ((a) == (b))
+#define EQ_c_coords(a, b) ((a).x == (b).x && (a).z == (b).z)
+#define EQ_b_coords(a, b) ((a).x == (b).x && (a).y == (b).y && (a).z == (b).z)
+#define EQ_extent(a, b) ((a).x == (b).x && (a).y == (b).y && (a).z == (b).z)
+
+/* length fields come first, the payload then sets them */
+#define SET_F(type, name, prefix, style) \
+    SET_##type(in.name, seed); \
+    seed++;
+
+#define SET_V(name, length, scale, prefix, style) \
+    in.length = (mc_i16) len; \
+    in.name = payload;
+
+#define EQ_F(type, name, prefix, style) \
+    CHECK(EQ_##type(in.name, out.name));
+
+#define EQ_V(name, length, scale, prefix, style) \
+    CHECK(memcmp(in.name, out.name, (size_t) in.length * scale) == 0);
+
+#define EID_F(type, name, prefix, style) PKT_IF_EID_##type(eids++;)
+#define EID_V(name, length, scale, prefix, style)
+
+/*
+ * makes the bytes of a written packet contiguous, following its iovec list
+ * when there is one
+ */
+static void
+gather(struct pkt_buffer* w, struct pkt_iovec* v, struct pkt_buffer* flat) {
+    CHECK(pkt_buffer_init(flat, 4096) != NULL);
+    if (v == NULL) {
+        memcpy(flat->data, w->data, w->cur);
+        flat->cur = w->cur;
+        return;
+    }
+
+    size_t const count = pkt_iovec_finish(v, w);
+    for (size_t i = 0; i < count; i++) {
+        CHECK(flat->cur + v->iov[i].iov_len <= flat->capacity);
+        memcpy(&flat->data[flat->cur], v->iov[i].iov_base, v->iov[i].iov_len);
+        flat->cur += v->iov[i].iov_len;
+    }
+    CHECK(flat->cur == w->out_total);
+}
+
+/*
+ * the peek on the raw payload and the getter on the decoded packet have to
+ * find the same entities, every entity id field of the packet
+ */
+static void
+check_entities(struct pkt_table const* t, mc_byte const id, mc_byte const* payload,
+               void const* pkt, size_t const eids) {
+    entity_id peeked[PKT_MAX_ENTITIES];
+    entity_id got[PKT_MAX_ENTITIES];
+    size_t const n = pkt_peek_entities(t, id, payload, peeked);
+    CHECK(n == eids);
+    CHECK(t->entry[id].entity(pkt, got) == n);
+    for (size_t i = 0; i < n; i++) {
+        CHECK(got[i] == peeked[i]);
+    }
+}
+
+/*
+ * reads the id of a written packet, and checks that the measure agrees with
+ * the size it was written at
+ */
+static void
+check_framing(struct pkt_table const* t, struct pkt_buffer* flat, mc_byte const id) {
+    mc_byte got;
+    CHECK(read_packet_id(flat, &got) == 0);
+    CHECK(got == id);
+
+    size_t const avail = flat->cur - flat->pos;
+    bool final;
+    CHECK(pkt_length_final(t, id, &flat->data[flat->pos], avail, &final) == avail);
+    CHECK(final);
+    CHECK(pkt_length_final(t, id, &flat->data[flat->pos], avail - 1, &final) > avail - 1);
+}
+
+#define ROUND_TRIP(PFX, pfx, NAME, lower, id, label, print, suffix) \
+    PKT_IF_BARE_##print({ \
+        struct pkt_buffer w; \
+        CHECK(pkt_buffer_init(&w, 4096) != NULL); \
+        CHECK(write_##pfx##_pkt_##lower(&w) == 0); \
+        CHECK(w.cur == sizeof(mc_byte)); \
+        \
+        mc_byte got; \
+        CHECK(read_packet_id(&w, &got) == 0); \
+        CHECK(got == PFX##_##NAME); \
+        CHECK(pkt_length(&pkt_##pfx##_table, got, &w.data[w.pos], 0) == 0); \
+        CHECK(read_##pfx##_pkt_##lower(&w) == 0); \
+        pkt_buffer_end(&w); \
+    }) \
+    PKT_IF_FIELDS_##print({ \
+        struct pfx##_pkt_##lower in; \
+        struct pfx##_pkt_##lower out; \
+        memset(&in, 0, sizeof in); \
+        memset(&out, 0, sizeof out); \
+        int seed = 1; \
+        PKT_FIELDS(PFX, NAME, SET_F, SET_V) \
+        (void) seed; \
+        \
+        struct pkt_buffer w; \
+        CHECK(pkt_buffer_init(&w, 4096) != NULL); \
+        struct iovec iov[IOVECS]; \
+        struct pkt_iovec v; \
+        pkt_iovec_init(&v, iov, IOVECS, &w); \
+        struct pkt_iovec* list = scattered ? &v : NULL; \
+        CHECK(write_##pfx##_pkt_##lower(&w, list, &in) == 0); \
+        \
+        struct pkt_buffer flat; \
+        gather(&w, list, &flat); \
+        size_t const size = flat.cur; \
+        check_framing(&pkt_##pfx##_table, &flat, PFX##_##NAME); \
+        size_t const payload = flat.pos; \
+        CHECK(read_##pfx##_pkt_##lower(&flat, &out) == 0); \
+        CHECK(flat.pos == flat.cur); \
+        PKT_FIELDS(PFX, NAME, EQ_F, EQ_V) \
+        \
+        size_t eids = 0; \
+        PKT_FIELDS(PFX, NAME, EID_F, EID_V) \
+        check_entities(&pkt_##pfx##_table, PFX##_##NAME, &flat.data[payload], &out, eids); \
+        \
+        mc_byte byte = 0; \
+        struct pkt_buffer tiny = {.data = &byte, .capacity = sizeof byte}; \
+        CHECK(write_##pfx##_pkt_##lower(&tiny, NULL, &in) == size); \
+        CHECK(tiny.overflow && tiny.cur == 0 && tiny.out_total == 0); \
+        \
+        pkt_buffer_end(&flat); \
+        pkt_buffer_end(&w); \
+    })
+
+/*
+ * writes and reads back every packet, with payloads of the given length,
+ * either copied or referenced from an iovec list. the entities found in it
+ * are checked along the way.
+ */
+static void
+round_trip(size_t const len, bool const scattered) {
+    CLI_PACKETS(ROUND_TRIP)
+    SRV_PACKETS(ROUND_TRIP)
+}
+
+int
+main(void) {
+    for (size_t i = 0; i < sizeof payload; i++) {
+        payload[i] = (mc_byte) (i * 31 + 7);
+    }
+
+    /* short payloads are always copied, long ones can be referenced */
+    size_t const lengths[] = {0, 5, 70, 256};
+    for (size_t i = 0; i < sizeof lengths / sizeof lengths[0]; i++) {
+        round_trip(lengths[i], false);
+        round_trip(lengths[i], true);
+    }
+    return EXIT_SUCCESS;
+}